@@ -0,0 +1,767 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "config.h"
+#include "errors.h"
+#include "io.h"
+#include "lane_kernels.h"
+#include "memory.h"
+#include "profile.h"
+#include "scan_kernels.h"
+#include "scanner.h"
+#include "vm.h"
+
+// Times one phase of the interpreter over a source file and prints the
+// timings as a JSON object. Run by `meson test --benchmark`, see bench/meson.build.
+
+// The dispatch the VM was built with, as vm.c decides it. clox-bench-switch
+// builds its own copy of vm.c with CLOX_SWITCH_DISPATCH.
+#if defined(CLOX_THREADED_DISPATCH) && defined(__GNUC__) && !defined(CLOX_SWITCH_DISPATCH)
+#define DISPATCH_NAME "threaded"
+#else
+#define DISPATCH_NAME "switch"
+#endif
+
+// The exit status meson reports as a skipped test.
+#define EXIT_SKIPPED 77
+
+typedef enum CloxBenchPhase {
+    PHASE_SCAN,
+    PHASE_COMPILE,
+    PHASE_EXECUTE,
+    PHASE_EVALUATE,
+    PHASE_LANES,
+    PHASE_NATIVE
+} CloxBenchPhase;
+
+typedef struct CloxBenchOptions CloxBenchOptions;
+struct CloxBenchOptions {
+    const char *name;
+    const char *path;
+    const char *kernel;
+    CloxNumberFormat number_format;
+    CloxBenchPhase phase;
+    bool lines;
+    bool jit;
+    bool unfused;
+    bool count_instructions;
+    int threads;
+    int rows;
+    int iterations;
+    int warmup;
+};
+
+// The programs a pass works through: the whole file, or each of its lines
+// when the workload stands in for a REPL or --batch session.
+typedef struct CloxBenchPrograms CloxBenchPrograms;
+struct CloxBenchPrograms {
+    char *text;
+    size_t size;
+    char **programs;
+    int count;
+};
+
+static const char * const phase_names[] = {
+    [PHASE_SCAN] = "scan",
+    [PHASE_COMPILE] = "compile",
+    [PHASE_EXECUTE] = "execute",
+    [PHASE_EVALUATE] = "evaluate",
+    [PHASE_LANES] = "lanes",
+    [PHASE_NATIVE] = "native"
+};
+
+#ifdef CLOX_BENCH_NATIVE
+// Defined by the C file clox --emit-c wrote for the workload, which this
+// build of the benchmark is linked with for the native phase.
+double clox_expression(const double *inputs);
+#endif
+
+// The evaluate, lanes and native phases run a single expression over these inputs,
+// once for each of --rows rows of generated values.
+static const char * const input_names[] = { "a", "b", "c", "d", "e", "f", "g", "h" };
+
+#define INPUT_COUNT ((int)(sizeof(input_names) / sizeof(input_names[0])))
+
+// A table of inputs in columns, as clox_vm_run_lanes() takes them.
+typedef struct CloxBenchTable CloxBenchTable;
+struct CloxBenchTable {
+    double *columns[INPUT_COUNT];
+    double *results;
+    size_t rows;
+};
+
+// What each of the --threads threads works through. VMs share nothing, so
+// every thread gets its own VM and its own copy of the compiled chunks.
+typedef struct CloxBenchWorker CloxBenchWorker;
+struct CloxBenchWorker {
+    const CloxBenchOptions *options;
+    const CloxBenchPrograms *programs;
+    CloxBenchTable *table;
+    CloxVM *vm;
+    CloxChunk *chunks;
+    uint64_t result;
+    pthread_t thread;
+};
+
+static void usage(const char * const name) {
+    fprintf(
+        stderr,
+        "Usage: %s --phase scan|compile|execute|evaluate|lanes|native [--lines] [--kernel scalar|sse2|avx2]\n"
+        "       [--numbers shortest|printf] [--jit] [--unfused] [--count-instructions] [--threads N] [--rows N]\n"
+        "       [--iterations N] [--warmup N] [--name NAME] <path>\n",
+        name);
+    exit(CLOX_EXIT_USAGE_ERROR);
+}
+
+static int parse_count(const char * const name, const char * const value) {
+    char *end;
+    long count = strtol(value, &end, 10);
+
+    if (*value == '\0' || *end != '\0' || count < 0 || count > 1000000) {
+        fprintf(stderr, "Invalid value \"%s\" for %s.\n", value, name);
+        exit(CLOX_EXIT_USAGE_ERROR);
+    }
+
+    return (int)count;
+}
+
+static CloxBenchOptions parse_options(int argc, char *argv[]) {
+    CloxBenchOptions options = { NULL, NULL, NULL, CLOX_NUMBER_FORMAT_SHORTEST, PHASE_SCAN, false, false, false, false, 1, 100000, 10, 1 };
+    bool hasPhase = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char * const arg = argv[i];
+        const char * const value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--lines") == 0) {
+            options.lines = true;
+        } else if (strcmp(arg, "--jit") == 0) {
+            options.jit = true;
+        } else if (strcmp(arg, "--phase") == 0 && value != NULL) {
+            hasPhase = true;
+            i++;
+
+            if (strcmp(value, "scan") == 0) {
+                options.phase = PHASE_SCAN;
+            } else if (strcmp(value, "compile") == 0) {
+                options.phase = PHASE_COMPILE;
+            } else if (strcmp(value, "execute") == 0) {
+                options.phase = PHASE_EXECUTE;
+            } else if (strcmp(value, "evaluate") == 0) {
+                options.phase = PHASE_EVALUATE;
+            } else if (strcmp(value, "lanes") == 0) {
+                options.phase = PHASE_LANES;
+            } else if (strcmp(value, "native") == 0) {
+                options.phase = PHASE_NATIVE;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (strcmp(arg, "--unfused") == 0) {
+            options.unfused = true;
+        } else if (strcmp(arg, "--count-instructions") == 0) {
+            options.count_instructions = true;
+        } else if (strcmp(arg, "--threads") == 0 && value != NULL) {
+            options.threads = parse_count(arg, value);
+            i++;
+        } else if (strcmp(arg, "--rows") == 0 && value != NULL) {
+            options.rows = parse_count(arg, value);
+            i++;
+        } else if (strcmp(arg, "--iterations") == 0 && value != NULL) {
+            options.iterations = parse_count(arg, value);
+            i++;
+        } else if (strcmp(arg, "--warmup") == 0 && value != NULL) {
+            options.warmup = parse_count(arg, value);
+            i++;
+        } else if (strcmp(arg, "--kernel") == 0 && value != NULL) {
+            options.kernel = value;
+            i++;
+        } else if (strcmp(arg, "--numbers") == 0 && value != NULL) {
+            i++;
+
+            if (strcmp(value, "shortest") == 0) {
+                options.number_format = CLOX_NUMBER_FORMAT_SHORTEST;
+            } else if (strcmp(value, "printf") == 0) {
+                options.number_format = CLOX_NUMBER_FORMAT_PRINTF;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (strcmp(arg, "--name") == 0 && value != NULL) {
+            options.name = value;
+            i++;
+        } else if (arg[0] != '-' && options.path == NULL) {
+            options.path = arg;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (!hasPhase || options.path == NULL || options.iterations == 0 || options.threads == 0) {
+        usage(argv[0]);
+    }
+
+    // The other phases share one table of inputs and results.
+    if (options.threads > 1 && options.phase > PHASE_EXECUTE) {
+        fprintf(stderr, "--threads only applies to the scan, compile and execute phases.\n");
+        exit(CLOX_EXIT_USAGE_ERROR);
+    }
+
+    // Only these phases go through the VM's dispatch loop.
+    if ((options.unfused || options.count_instructions)
+            && options.phase != PHASE_EXECUTE && options.phase != PHASE_EVALUATE) {
+        fprintf(stderr, "--unfused and --count-instructions only apply to the execute and evaluate phases.\n");
+        exit(CLOX_EXIT_USAGE_ERROR);
+    }
+
+    if (options.name == NULL) {
+        options.name = options.path;
+    }
+
+    return options;
+}
+
+// Switches the scanner, or for the lanes phase the lane kernels, to the named
+// kernels. Exits as skipped if the CPU can't run them.
+static void select_kernels(CloxBenchPhase phase, const char * const name) {
+    const char * const kind = phase == PHASE_LANES ? "lane" : "scan";
+    const char * const names[] = { "scalar", "sse2", "avx2" };
+
+    for (int level = 0; level < (int)(sizeof(names) / sizeof(names[0])); level++) {
+        if (strcmp(name, names[level]) == 0) {
+            bool selected = phase == PHASE_LANES
+                ? clox_lane_kernels_select((CloxLaneLevel)level)
+                : clox_scan_kernels_select((CloxScanLevel)level);
+
+            if (!selected) {
+                fprintf(stderr, "The %s %s kernels aren't supported here.\n", name, kind);
+                exit(EXIT_SKIPPED);
+            }
+
+            return;
+        }
+    }
+
+    fprintf(stderr, "Unknown %s kernels \"%s\".\n", kind, name);
+    exit(CLOX_EXIT_USAGE_ERROR);
+}
+
+static CloxBenchPrograms load_programs(const CloxBenchOptions * const options) {
+    CloxSource source;
+    clox_source_open(&source, options->path);
+
+    CloxBenchPrograms programs;
+    programs.size = source.length;
+    programs.text = (char *)malloc(source.length + 1);
+    memcpy(programs.text, source.text, source.length + 1);
+    clox_source_close(&source);
+
+    int capacity = 1;
+
+    if (options->lines) {
+        for (size_t i = 0; i < programs.size; i++) {
+            capacity += programs.text[i] == '\n';
+        }
+    }
+
+    programs.programs = (char **)malloc(sizeof(char *) * (size_t)capacity);
+    programs.count = 0;
+
+    if (!options->lines) {
+        programs.programs[programs.count++] = programs.text;
+        return programs;
+    }
+
+    char *line = programs.text;
+
+    while (*line != '\0') {
+        char *newline = strchr(line, '\n');
+
+        if (newline != NULL) {
+            *newline = '\0';
+        }
+
+        if (*line != '\0') {
+            programs.programs[programs.count++] = line;
+        }
+
+        if (newline == NULL) {
+            break;
+        }
+
+        line = newline + 1;
+    }
+
+    return programs;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// Tokens are summed up and returned so the scanning can't be optimized out.
+static uint64_t scan_pass(const CloxBenchPrograms * const programs) {
+    uint64_t tokens = 0;
+
+    for (int i = 0; i < programs->count; i++) {
+        CloxScanner scanner;
+        clox_scanner_init(&scanner, programs->programs[i]);
+
+        while (clox_scanner_scan_token(&scanner).type != TOKEN_EOF) {
+            tokens++;
+        }
+    }
+
+    return tokens;
+}
+
+// Programs are compiled with the inputs only for the phases that supply them.
+static void compile_or_exit(const char * const program, bool inputs, CloxChunk * const chunk) {
+    if (!clox_compiler_compile_inputs(program, input_names, inputs ? INPUT_COUNT : 0, chunk)) {
+        fprintf(stderr, "Workload failed to compile.\n");
+        exit(CLOX_EXIT_COMPILE_ERROR);
+    }
+}
+
+// One chunk is reused across the programs of a pass, as in --batch.
+static uint64_t compile_pass(const CloxBenchPrograms * const programs) {
+    uint64_t bytes = 0;
+    CloxChunk chunk;
+    clox_chunk_init(&chunk);
+
+    for (int i = 0; i < programs->count; i++) {
+        compile_or_exit(programs->programs[i], false, &chunk);
+        bytes += (uint64_t)chunk.count;
+        clox_chunk_reset(&chunk);
+    }
+
+    clox_chunk_free(&chunk);
+    return bytes;
+}
+
+static uint64_t execute_pass(CloxVM * const vm, CloxChunk * const chunks, int count) {
+    uint64_t failures = 0;
+
+    for (int i = 0; i < count; i++) {
+        failures += clox_vm_interpret_chunk(vm, &chunks[i]) != INTERPRET_OK;
+    }
+
+    return failures;
+}
+
+// Fills the table with values spread over a few orders of magnitude, the same
+// on every run.
+static void table_init(CloxBenchTable * const table, int rows) {
+    uint64_t state = 0x9e3779b97f4a7c15u;
+    table->rows = (size_t)rows;
+    table->results = (double *)malloc(sizeof(double) * table->rows);
+
+    for (int input = 0; input < INPUT_COUNT; input++) {
+        table->columns[input] = (double *)malloc(sizeof(double) * table->rows);
+
+        for (size_t row = 0; row < table->rows; row++) {
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            table->columns[input][row] = (double)(int32_t)(state >> 32) / 65536.0;
+        }
+    }
+}
+
+static void table_free(CloxBenchTable * const table) {
+    for (int input = 0; input < INPUT_COUNT; input++) {
+        free(table->columns[input]);
+    }
+
+    free(table->results);
+}
+
+// One clox_vm_evaluate() per row, the way an embedder would go without
+// clox_vm_run_lanes().
+static uint64_t evaluate_pass(CloxVM * const vm, CloxChunk * const chunk, CloxBenchTable * const table) {
+    uint64_t failures = 0;
+    double inputs[INPUT_COUNT];
+
+    for (size_t row = 0; row < table->rows; row++) {
+        for (int input = 0; input < INPUT_COUNT; input++) {
+            inputs[input] = table->columns[input][row];
+        }
+
+        CloxValue result;
+        failures += clox_vm_evaluate(vm, chunk, inputs, &result) != INTERPRET_OK;
+        table->results[row] = CLOX_AS_NUMBER(result);
+    }
+
+    return failures;
+}
+
+static uint64_t lanes_pass(CloxVM * const vm, CloxChunk * const chunk, CloxBenchTable * const table) {
+    const double * const * const columns = (const double * const *)table->columns;
+    return clox_vm_run_lanes(vm, chunk, columns, table->rows, table->results) != INTERPRET_OK;
+}
+
+#ifdef CLOX_BENCH_NATIVE
+// The expression as compiled by a C compiler from the --emit-c output, row by
+// row like evaluate_pass(), for a bound on what the interpreter could reach.
+static uint64_t native_pass(CloxBenchTable * const table) {
+    double inputs[INPUT_COUNT];
+
+    for (size_t row = 0; row < table->rows; row++) {
+        for (int input = 0; input < INPUT_COUNT; input++) {
+            inputs[input] = table->columns[input][row];
+        }
+
+        table->results[row] = clox_expression(inputs);
+    }
+
+    return 0;
+}
+#endif
+
+// Rewrites every constant-operand superinstruction in the chunk as the
+// constant load and arithmetic instruction it stands for, to measure what the
+// fusion saves.
+static void unfuse(CloxChunk * const chunk) {
+    CloxChunk unfused;
+    clox_chunk_init(&unfused);
+    unfused.input_count = chunk->input_count;
+
+    // The pool holds distinct values, so they keep their indexes.
+    for (int i = 0; i < chunk->constants.count; i++) {
+        clox_chunk_add_constant(&unfused, chunk->constants.values[i]);
+    }
+
+    clox_chunk_free_constant_index(&unfused);
+
+    for (int offset = 0; offset < chunk->count;) {
+        const uint8_t instruction = chunk->code[offset];
+        const int line = clox_chunk_get_line(chunk, offset);
+        int length = 1;
+
+        switch (instruction) {
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT:
+                clox_chunk_write(&unfused, OP_CONSTANT, line);
+                clox_chunk_write(&unfused, chunk->code[offset + 1], line);
+                clox_chunk_write(&unfused, (uint8_t)(instruction - OP_ADD_CONSTANT + OP_ADD), line);
+                offset += 2;
+                continue;
+
+            case OP_CONSTANT:
+            case OP_INPUT:
+                length = 2;
+                break;
+
+            case OP_CONSTANT_LONG:
+                length = 3;
+                break;
+
+            default:
+                break;
+        }
+
+        for (int i = 0; i < length; i++) {
+            clox_chunk_write(&unfused, chunk->code[offset + i], line);
+        }
+
+        offset += length;
+    }
+
+    unfused.max_stack = clox_chunk_compute_max_stack(&unfused);
+    clox_chunk_free(chunk);
+    *chunk = unfused;
+}
+
+static void worker_init(
+        CloxBenchWorker * const worker,
+        const CloxBenchOptions * const options,
+        const CloxBenchPrograms * const programs,
+        CloxBenchTable * const table) {
+    worker->options = options;
+    worker->programs = programs;
+    worker->table = table;
+    worker->chunks = NULL;
+    worker->result = 0;
+
+    // Results are held and written out in blocks, as with --batch.
+    worker->vm = clox_vm_new();
+    clox_vm_set_output_batching(worker->vm, true);
+    clox_vm_set_number_format(worker->vm, options->number_format);
+
+    // Chunks are compiled on their first run, which the warmup takes care of.
+    if (options->jit) {
+        clox_vm_set_jit(worker->vm, 1);
+    }
+
+    if (options->phase != PHASE_SCAN && options->phase != PHASE_COMPILE) {
+        const bool inputs = options->phase != PHASE_EXECUTE;
+        worker->chunks = (CloxChunk *)malloc(sizeof(CloxChunk) * (size_t)programs->count);
+
+        for (int i = 0; i < programs->count; i++) {
+            clox_chunk_init(&worker->chunks[i]);
+            compile_or_exit(programs->programs[i], inputs, &worker->chunks[i]);
+
+            if (options->unfused) {
+                unfuse(&worker->chunks[i]);
+            }
+        }
+    }
+}
+
+static void worker_free(CloxBenchWorker * const worker) {
+    if (worker->chunks != NULL) {
+        for (int i = 0; i < worker->programs->count; i++) {
+            clox_chunk_free(&worker->chunks[i]);
+        }
+
+        free(worker->chunks);
+    }
+
+    clox_vm_free(worker->vm);
+}
+
+// One pass of the phase, leaving the token count, bytes or failures that keep
+// it from being optimized out in `result`.
+static void *run_pass(void *argument) {
+    CloxBenchWorker * const worker = (CloxBenchWorker *)argument;
+
+    switch (worker->options->phase) {
+        case PHASE_SCAN:
+            worker->result = scan_pass(worker->programs);
+            break;
+
+        case PHASE_COMPILE:
+            worker->result = compile_pass(worker->programs);
+            break;
+
+        case PHASE_EXECUTE:
+            worker->result = execute_pass(worker->vm, worker->chunks, worker->programs->count);
+            break;
+
+        case PHASE_EVALUATE:
+            worker->result = evaluate_pass(worker->vm, &worker->chunks[0], worker->table);
+            break;
+
+        case PHASE_LANES:
+            worker->result = lanes_pass(worker->vm, &worker->chunks[0], worker->table);
+            break;
+
+        case PHASE_NATIVE:
+#ifdef CLOX_BENCH_NATIVE
+            worker->result = native_pass(worker->table);
+#endif
+            break;
+    }
+
+    return NULL;
+}
+
+// Runs a pass on every worker at once, or on the calling thread when there is
+// just the one.
+static void run_workers(CloxBenchWorker * const workers, int count) {
+    if (count == 1) {
+        run_pass(&workers[0]);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, run_pass, &workers[i]) != 0) {
+            fprintf(stderr, "Failed to start a thread.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+// Instructions the VM dispatches in one pass, counted by a profile on a run
+// of its own so that profiling doesn't slow down the timed ones.
+static uint64_t count_instructions(CloxBenchWorker * const worker) {
+    CloxProfile * const profile = clox_profile_new();
+    clox_vm_set_profile(worker->vm, profile);
+    run_pass(worker);
+    clox_vm_set_profile(worker->vm, NULL);
+
+    uint64_t instructions = 0;
+
+    for (int opcode = 0; opcode <= UINT8_MAX; opcode++) {
+        instructions += profile->opcodes[opcode].count;
+    }
+
+    clox_profile_free(profile);
+    return instructions;
+}
+
+static int compare_samples(const void *a, const void *b) {
+    uint64_t sampleA = *(const uint64_t *)a;
+    uint64_t sampleB = *(const uint64_t *)b;
+    return (sampleA > sampleB) - (sampleA < sampleB);
+}
+
+// Nearest-rank percentile of sorted samples.
+static uint64_t percentile(const uint64_t * const samples, int count, int percent) {
+    int rank = (percent * count + 99) / 100;
+    return samples[rank > 0 ? rank - 1 : 0];
+}
+
+static void print_json(
+        FILE * const out,
+        const CloxBenchOptions * const options,
+        const CloxBenchPrograms * const programs,
+        uint64_t tokens,
+        size_t rows,
+        uint64_t instructions,
+        uint64_t * const samples) {
+    int count = options->iterations;
+    qsort(samples, (size_t)count, sizeof(uint64_t), compare_samples);
+
+    uint64_t total = 0;
+
+    for (int i = 0; i < count; i++) {
+        total += samples[i];
+    }
+
+    uint64_t median = count % 2 == 1
+        ? samples[count / 2]
+        : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+
+    // Throughput counts the work of every thread.
+    const double threads = (double)options->threads;
+
+    fprintf(out, "{\"name\": \"%s\", ", options->name);
+    fprintf(out, "\"phase\": \"%s\", ", phase_names[options->phase]);
+    fprintf(out, "\"bytes\": %zu, \"programs\": %d, ", programs->size, programs->count);
+    fprintf(out, "\"iterations\": %d, \"unit\": \"ns\", ", count);
+    fprintf(out, "\"min\": %llu, ", (unsigned long long)samples[0]);
+    fprintf(out, "\"median\": %llu, ", (unsigned long long)median);
+    fprintf(out, "\"p90\": %llu, ", (unsigned long long)percentile(samples, count, 90));
+    fprintf(out, "\"p99\": %llu, ", (unsigned long long)percentile(samples, count, 99));
+    fprintf(out, "\"max\": %llu, ", (unsigned long long)samples[count - 1]);
+    fprintf(out, "\"mean\": %llu, ", (unsigned long long)(total / (uint64_t)count));
+    fprintf(out, "\"mb_per_s\": %.2f", median == 0 ? 0.0 : (double)programs->size * threads * 1000.0 / (double)median);
+
+    if (options->phase == PHASE_SCAN) {
+        fprintf(out, ", \"kernel\": \"%s\", ", clox_scan_kernels()->name);
+        fprintf(out, "\"tokens\": %llu, ", (unsigned long long)tokens);
+        fprintf(out, "\"tokens_per_s\": %.0f", median == 0 ? 0.0 : (double)tokens * threads * 1e9 / (double)median);
+    }
+
+    if (options->phase == PHASE_EVALUATE || options->phase == PHASE_LANES || options->phase == PHASE_NATIVE) {
+        if (options->phase == PHASE_LANES) {
+            fprintf(out, ", \"kernel\": \"%s\"", clox_lane_kernels()->name);
+        }
+
+        fprintf(out, ", \"rows\": %zu, ", rows);
+        fprintf(out, "\"rows_per_s\": %.0f", median == 0 ? 0.0 : (double)rows * 1e9 / (double)median);
+    }
+
+    if (options->count_instructions) {
+        fprintf(out, ", \"dispatch\": \"%s\", ", DISPATCH_NAME);
+        fprintf(out, "\"instructions\": %llu, ", (unsigned long long)instructions);
+        fprintf(out, "\"instructions_per_s\": %.0f", median == 0 ? 0.0 : (double)instructions * threads * 1e9 / (double)median);
+    }
+
+    if (options->unfused) {
+        fprintf(out, ", \"unfused\": true");
+    }
+
+    if (options->jit) {
+        fprintf(out, ", \"jit\": true");
+    }
+
+    if (options->threads > 1) {
+        fprintf(out, ", \"threads\": %d", options->threads);
+    }
+
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char *argv[]) {
+    const CloxBenchOptions options = parse_options(argc, argv);
+    CloxBenchPrograms programs = load_programs(&options);
+
+    if (options.kernel != NULL) {
+        select_kernels(options.phase, options.kernel);
+    }
+
+#ifndef CLOX_BENCH_NATIVE
+    if (options.phase == PHASE_NATIVE) {
+        fprintf(stderr, "The native phase needs the clox-bench-native build.\n");
+        return EXIT_SKIPPED;
+    }
+#endif
+
+    // The VM prints every result, which would swamp the report, so stdout is
+    // pointed at /dev/null and the report goes to a copy of the original.
+    FILE * const report = fdopen(dup(STDOUT_FILENO), "w");
+
+    if (report == NULL || freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "Failed to redirect standard output.\n");
+        return CLOX_EXIT_FILE_ERROR;
+    }
+
+    CloxBenchTable table = { { NULL }, NULL, 0 };
+
+    if (options.phase > PHASE_EXECUTE) {
+        table_init(&table, options.rows);
+
+        if (programs.count != 1) {
+            fprintf(stderr, "The %s phase takes a single expression.\n", phase_names[options.phase]);
+            return CLOX_EXIT_USAGE_ERROR;
+        }
+    }
+
+    CloxBenchWorker *workers = (CloxBenchWorker *)malloc(sizeof(CloxBenchWorker) * (size_t)options.threads);
+
+    for (int i = 0; i < options.threads; i++) {
+        worker_init(&workers[i], &options, &programs, &table);
+    }
+
+    uint64_t *samples = (uint64_t *)malloc(sizeof(uint64_t) * (size_t)options.iterations);
+    volatile uint64_t sink = 0;
+
+    for (int i = -options.warmup; i < options.iterations; i++) {
+        uint64_t start = now_ns();
+        run_workers(workers, options.threads);
+
+        if (i >= 0) {
+            samples[i] = now_ns() - start;
+        }
+
+        for (int worker = 0; worker < options.threads; worker++) {
+            sink += workers[worker].result;
+        }
+    }
+
+    (void)sink;
+
+    // Every thread scans the same tokens.
+    const uint64_t tokens = options.phase == PHASE_SCAN ? workers[0].result : 0;
+    const uint64_t instructions = options.count_instructions ? count_instructions(&workers[0]) : 0;
+    print_json(report, &options, &programs, tokens, table.rows, instructions, samples);
+    fclose(report);
+
+    for (int i = 0; i < options.threads; i++) {
+        worker_free(&workers[i]);
+    }
+
+    free(workers);
+    table_free(&table);
+    free(samples);
+    free(programs.programs);
+    free(programs.text);
+
+    return 0;
+}
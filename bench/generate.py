@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Writes synthetic Lox sources for the benchmark suite.
+
+    generate.py nesting DEPTH OUTPUT     -(-(...(1 + 2)...)) nested DEPTH deep
+    generate.py wide-sum TERMS OUTPUT    a single sum of TERMS numbers
+    generate.py constants COUNT OUTPUT   one expression over COUNT distinct numbers
+    generate.py repl LINES OUTPUT        LINES short expressions, one per line
+    generate.py tokens LINES OUTPUT      LINES of comments, identifiers, strings and
+                                         numbers; scans but doesn't compile
+    generate.py identifiers LINES OUTPUT LINES of keywords and short identifiers;
+                                         scans but doesn't compile
+    generate.py inputs TERMS OUTPUT      one expression of TERMS terms over the
+                                         inputs a to h
+
+Output is deterministic for a given kind and size, so results stay
+comparable between runs and versions.
+"""
+
+import random
+import sys
+
+OPERATORS = "+-*/"
+
+
+def nesting(depth, out):
+    # Alternate groupings with negations so both the grouping and the unary
+    # rule recurse.
+    for level in range(depth):
+        out.write("(" if level % 2 else "-(")
+    out.write("1 + 2")
+    out.write(")" * depth)
+    out.write("\n")
+
+
+def wide_sum(terms, out):
+    rng = random.Random(terms)
+    line = []
+
+    for term in range(terms):
+        if term > 0:
+            line.append(" + ")
+        line.append(str(rng.randint(1, 9)))
+
+        if len(line) >= 64:
+            out.write("".join(line))
+            out.write("\n")
+            line = []
+
+    out.write("".join(line))
+    out.write("\n")
+
+
+def constants(count, out):
+    # Every number is distinct so the constant pool and its index grow with
+    # the input, mixing in fractions and every operator.
+    rng = random.Random(count)
+
+    for index in range(count):
+        if index > 0:
+            out.write(" %s " % rng.choice(OPERATORS))
+        out.write("%d.%d" % (index + 1, rng.randint(0, 999)))
+
+        if index % 16 == 15:
+            out.write("\n")
+
+    out.write("\n")
+
+
+def repl(lines, out):
+    rng = random.Random(lines)
+
+    for _ in range(lines):
+        expression = str(rng.randint(1, 999))
+
+        for _ in range(rng.randint(0, 4)):
+            expression += " %s %d" % (rng.choice(OPERATORS), rng.randint(1, 999))
+
+        if rng.random() < 0.2:
+            expression = "-(%s)" % expression
+
+        out.write(expression)
+        out.write("\n")
+
+
+def tokens(lines, out):
+    # Long comments, identifiers, strings and indentation, which is what
+    # generated sources tend to be made of.
+    rng = random.Random(lines)
+    letters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"
+
+    def word(low, high):
+        return rng.choice(letters[:53]) + "".join(
+            rng.choice(letters) for _ in range(rng.randint(low, high)))
+
+    for _ in range(lines):
+        kind = rng.randint(0, 3)
+        out.write(" " * (4 * rng.randint(0, 4)))
+
+        if kind == 0:
+            out.write("// " + " ".join(word(2, 12) for _ in range(rng.randint(4, 12))))
+        elif kind == 1:
+            out.write("var %s = %s;" % (word(8, 40), word(8, 40)))
+        elif kind == 2:
+            out.write('print "%s";' % " ".join(word(2, 10) for _ in range(rng.randint(2, 8))))
+        else:
+            out.write("%s = %d.%d * %s;" % (word(4, 16), rng.randint(0, 10 ** 9), rng.randint(0, 999), word(4, 16)))
+
+        out.write("\n")
+
+
+KEYWORDS = ("and class else false for fun if nil or print return super "
+            "this true var while").split()
+
+
+def identifiers(lines, out):
+    # Keywords, names that share a keyword's first letter or length, and
+    # other short names, which is what the keyword lookup sees in real code.
+    rng = random.Random(lines)
+    letters = "abcdefghijklmnopqrstuvwxyz"
+    near = [word[:-1] for word in KEYWORDS if len(word) > 2] + [word + "s" for word in KEYWORDS]
+
+    def name():
+        kind = rng.randint(0, 2)
+
+        if kind == 0:
+            return rng.choice(KEYWORDS)
+        if kind == 1:
+            return rng.choice(near)
+
+        return "".join(rng.choice(letters) for _ in range(rng.randint(1, 8)))
+
+    for _ in range(lines):
+        out.write(" ".join(name() for _ in range(rng.randint(4, 12))))
+        out.write(";\n")
+
+
+INPUTS = "abcdefgh"
+
+
+def inputs(terms, out):
+    # A formula of the kind that gets evaluated once per row of a table:
+    # mostly inputs, some constants, every operator and the odd negation.
+    rng = random.Random(terms)
+    expression = rng.choice(INPUTS)
+
+    for _ in range(terms - 1):
+        operand = rng.choice(INPUTS) if rng.random() < 0.75 else "%d.%d" % (rng.randint(1, 99), rng.randint(0, 9))
+
+        if rng.random() < 0.1:
+            operand = "-" + operand
+
+        expression = "(%s %s %s)" % (expression, rng.choice(OPERATORS), operand)
+
+    out.write(expression)
+    out.write("\n")
+
+
+GENERATORS = {
+    "nesting": nesting,
+    "wide-sum": wide_sum,
+    "constants": constants,
+    "repl": repl,
+    "tokens": tokens,
+    "identifiers": identifiers,
+    "inputs": inputs,
+}
+
+
+def main():
+    if len(sys.argv) != 4 or sys.argv[1] not in GENERATORS:
+        sys.stderr.write(__doc__)
+        return 2
+
+    with open(sys.argv[3], "w") as out:
+        GENERATORS[sys.argv[1]](int(sys.argv[2]), out)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
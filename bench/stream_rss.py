@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compiles a synthetic expression streamed into `clox -` and reports peak RSS.
+
+The expression is generated on the fly and written to the interpreter's
+standard input, so neither side ever holds the whole program in memory.
+
+    bench/stream_rss.py build/clox --gigabytes 2
+"""
+
+import argparse
+import subprocess
+import sys
+import threading
+import time
+
+TERM = b"1234567.5 + "
+BLOCK = TERM * (1 << 16)
+
+
+def watch_peak_rss(pid, peak):
+    """Samples the process's high-water mark until it exits.
+
+    The rusage of a child also counts what it inherited before exec, which
+    here would be this script, so the kernel's per-process VmHWM is used.
+    """
+    path = f"/proc/{pid}/status"
+
+    while True:
+        try:
+            with open(path) as status:
+                for line in status:
+                    if line.startswith("VmHWM:"):
+                        peak[0] = max(peak[0], int(line.split()[1]))
+        except OSError:
+            return
+
+        time.sleep(0.05)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("clox", help="path to the clox binary")
+    parser.add_argument("--gigabytes", type=float, default=2.0,
+                        help="size of the generated source (default: 2)")
+    args = parser.parse_args()
+
+    size = int(args.gigabytes * (1 << 30))
+    blocks = max(1, size // len(BLOCK))
+
+    start = time.monotonic()
+    process = subprocess.Popen([args.clox, "-"], stdin=subprocess.PIPE,
+                               stdout=subprocess.PIPE)
+    peak = [0]
+    watcher = threading.Thread(target=watch_peak_rss, args=(process.pid, peak))
+    watcher.start()
+
+    for _ in range(blocks):
+        process.stdin.write(BLOCK)
+
+    process.stdin.write(b"1\n")
+    process.stdin.close()
+    output = process.stdout.read().decode().strip()
+    status = process.wait()
+    elapsed = time.monotonic() - start
+    watcher.join()
+    streamed = blocks * len(BLOCK) + 2
+
+    print(f"streamed {streamed / (1 << 30):.2f} GiB in {elapsed:.1f} s "
+          f"({streamed / (1 << 20) / elapsed:.1f} MiB/s)")
+    print(f"result {output}, exit status {status}")
+    print(f"peak RSS {peak[0]} kB")
+
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chunk.h"
+
+#define CLOX_BYTECODE_MAGIC "LOXC"
+#define CLOX_BYTECODE_VERSION 3
+
+// A chunk loaded from a bytecode file. The chunk's arrays point straight into
+// a read-only mapping of the file, so it must be released with
+// clox_bytecode_unload rather than clox_chunk_free.
+typedef struct CloxBytecodeImage CloxBytecodeImage;
+struct CloxBytecodeImage {
+    void *mapping;
+    size_t size;
+    CloxChunk chunk;
+};
+
+bool clox_bytecode_is_image(const char * const path);
+bool clox_bytecode_write(const CloxChunk * const chunk, const char * const path);
+bool clox_bytecode_load(CloxBytecodeImage * const image, const char * const path);
+void clox_bytecode_unload(CloxBytecodeImage * const image);
@@ -4,30 +4,83 @@
 
 #include "value.h"
 
+// Native code for a chunk, see jit.h.
+typedef struct CloxJitCode CloxJitCode;
+
+// Most input slots a chunk can have; OP_INPUT takes a one-byte operand.
+#define CLOX_CHUNK_MAX_INPUTS (UINT8_MAX + 1)
+
+// Opcodes are stored as-is in bytecode files, so any change to this list must
+// come with a bump of CLOX_BYTECODE_VERSION in bytecode.h.
 typedef enum OpCode {
     OP_CONSTANT,
     OP_CONSTANT_LONG,
+    OP_NIL,
+    OP_TRUE,
+    OP_FALSE,
+    OP_INPUT,
     OP_ADD,
     OP_SUBTRACT,
     OP_MULTIPLY,
     OP_DIVIDE,
+    OP_ADD_CONSTANT,
+    OP_SUBTRACT_CONSTANT,
+    OP_MULTIPLY_CONSTANT,
+    OP_DIVIDE_CONSTANT,
     OP_NEGATE,
     OP_RETURN
 } OpCode;
 
+// A run of consecutive bytes in the chunk's code that all belong to the same
+// source line. The run extends up to the offset of the next run.
+typedef struct CloxLineRun CloxLineRun;
+struct CloxLineRun {
+    int offset;
+    int line;
+};
+
+// A chunk's code, line table and constants are either separate heap arrays,
+// arrays in an arena (`arena`, which the chunk doesn't own), or, once
+// compacted, one heap block (`block`) that can no longer be written to.
+// `input_count` is the number of input slots OP_INPUT reads from, which the
+// chunk has to be given values for when it runs. `jit` is the chunk's native
+// code once the VM has compiled it, dropped whenever the code changes, and
+// `jit_runs` counts the runs towards that, or is -1 if the chunk can't be
+// compiled. Dropped code is kept in `jit_spare` for the next compilation to
+// reuse its mapping.
 typedef struct CloxChunk CloxChunk;
 struct CloxChunk {
     int count;
     int capacity;
     uint8_t *code;
-    int *line_numbers;
+    int line_count;
+    int line_capacity;
+    CloxLineRun *lines;
     CloxValueArray constants;
+    CloxValueIndex constant_index;
+    int max_stack;
+    int input_count;
+    CloxJitCode *jit;
+    CloxJitCode *jit_spare;
+    int jit_runs;
+    CloxArena *arena;
+    void *block;
 };
 
 void clox_chunk_init(CloxChunk * const chunk);
+void clox_chunk_init_arena(CloxChunk * const chunk, CloxArena * const arena);
 void clox_chunk_write(CloxChunk * const chunk, uint8_t byte, int line);
 void clox_chunk_free(CloxChunk * const chunk);
+void clox_chunk_reset(CloxChunk * const chunk);
+void clox_chunk_compact(CloxChunk * const chunk);
+void clox_chunk_truncate(CloxChunk * const chunk, int count);
+
+int clox_chunk_get_line(const CloxChunk * const chunk, int offset);
+int clox_chunk_compute_max_stack(const CloxChunk * const chunk);
+bool clox_chunk_numbers_only(const CloxChunk * const chunk);
 
 void clox_chunk_write_constant(CloxChunk * const chunk, int index, int line);
 
 int clox_chunk_add_constant(CloxChunk * const chunk, CloxValue value);
+void clox_chunk_truncate_constants(CloxChunk * const chunk, int count);
+void clox_chunk_free_constant_index(CloxChunk * const chunk);
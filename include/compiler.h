@@ -4,4 +4,11 @@
 
 #include "chunk.h"
 
+// Deepest an expression can nest, counting every parenthesis, operator and
+// negation an operand is nested in. Deeper source is a compile error rather
+// than a crash once the C stack runs out.
+#define CLOX_COMPILER_MAX_DEPTH 10000
+
 bool clox_compiler_compile(const char * const source, CloxChunk *chunk);
+bool clox_compiler_compile_stream(int fd, CloxChunk *chunk);
+bool clox_compiler_compile_inputs(const char * const source, const char * const * const names, int count, CloxChunk *chunk);
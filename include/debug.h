@@ -1,6 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "chunk.h"
 
 void clox_chunk_disassemble(const CloxChunk * const chunk, const char * const name);
 int clox_chunk_disassemble_instruction(const CloxChunk * const chunk, int offset);
+const char * clox_opcode_name(uint8_t opcode);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "chunk.h"
+
+// Name of the function a C file from clox_emit_c_write() defines, unless it
+// is compiled with CLOX_EXPRESSION defined to another.
+#define CLOX_EMIT_C_FUNCTION "clox_expression"
+
+// Writes the chunk to `path` as a C file that computes the same result, see
+// emit_c.c. `names` holds the chunk's input names for comments, or is NULL.
+// The chunk has to pass clox_chunk_numbers_only().
+bool clox_emit_c_write(const CloxChunk * const chunk, const char * const * const names, const char * const path);
@@ -1,4 +1,32 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
+// Script source text, NUL-terminated as the scanner expects. Regular files
+// are mapped rather than copied; `mapped` is the size of the mapping to
+// release, or 0 when `text` is a heap buffer.
+typedef struct {
+    char *text;
+    size_t length;
+    size_t mapped;
+} CloxSource;
+
+// Splits input read from `fd` in large blocks into lines, which are handed out
+// NUL-terminated in place in the reader's buffer. A line stays valid until the
+// next call to clox_line_reader_next.
+typedef struct {
+    int fd;
+    bool eof;
+    char *buffer;
+    size_t capacity;
+    size_t start;
+    size_t count;
+} CloxLineReader;
+
 char * clox_read_line();
-char * clox_read_file(const char * const path);
+void clox_source_open(CloxSource * const source, const char * const path);
+void clox_source_close(CloxSource * const source);
+void clox_line_reader_init(CloxLineReader * const reader, int fd);
+char * clox_line_reader_next(CloxLineReader * const reader);
+void clox_line_reader_free(CloxLineReader * const reader);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "chunk.h"
+#include "value.h"
+
+// Native x86-64 code for a chunk, see jit.c. It lives in its own executable
+// mapping, which the chunk owns once it is stored in the chunk's `jit`.
+typedef struct CloxJitCode CloxJitCode;
+
+// Whether this build can generate native code at all.
+bool clox_jit_available(void);
+
+// Chunks with fewer bytes of code than this, such as a lone constant, run
+// about as fast in the interpreter and aren't translated.
+#define CLOX_JIT_MIN_CODE 8
+
+// Translates the chunk, or returns NULL if it is shorter than
+// CLOX_JIT_MIN_CODE, holds anything other than numbers and arithmetic or the
+// code can't be mapped. `spare` is code that is no longer needed, or NULL;
+// its mapping is reused if the new code fits and freed otherwise.
+CloxJitCode * clox_jit_compile(const CloxChunk * const chunk, CloxJitCode * const spare);
+
+// Runs the code with `stack` holding at least the chunk's max_stack slots
+// and `constants` and `inputs` those of the chunk it was compiled from, and
+// returns the chunk's result.
+double clox_jit_run(const CloxJitCode * const code, CloxValue * const stack, const CloxValue * const constants, const double * const inputs);
+
+void clox_jit_free(CloxJitCode * const code);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Loops that run one instruction over a block of lanes for
+// clox_vm_run_lanes(). Each reads `count` doubles from every operand row and
+// writes `count` doubles to `result`, which may be one of the operand rows.
+// Whatever the instruction set, every lane gets exactly the bits the
+// interpreter's scalar arithmetic would give it.
+typedef struct CloxLaneKernels CloxLaneKernels;
+struct CloxLaneKernels {
+    const char *name;
+
+    // a op b, lane by lane.
+    void (*add)(double *result, const double *a, const double *b, size_t count);
+    void (*subtract)(double *result, const double *a, const double *b, size_t count);
+    void (*multiply)(double *result, const double *a, const double *b, size_t count);
+    void (*divide)(double *result, const double *a, const double *b, size_t count);
+    // a op b for the same b in every lane.
+    void (*add_constant)(double *result, const double *a, double b, size_t count);
+    void (*subtract_constant)(double *result, const double *a, double b, size_t count);
+    void (*multiply_constant)(double *result, const double *a, double b, size_t count);
+    void (*divide_constant)(double *result, const double *a, double b, size_t count);
+    void (*negate)(double *result, const double *a, size_t count);
+    // Copies a column, making every NaN the canonical one the way
+    // clox_value_canonical() does.
+    void (*canonical)(double *result, const double *a, size_t count);
+    // Sets every lane to `value`.
+    void (*fill)(double *result, double value, size_t count);
+};
+
+typedef enum CloxLaneLevel {
+    CLOX_LANE_SCALAR,
+    CLOX_LANE_SSE2,
+    CLOX_LANE_AVX2,
+    CLOX_LANE_LEVEL_COUNT
+} CloxLaneLevel;
+
+// The widest kernels the CPU supports, picked on first use. Safe to call from
+// any thread.
+const CloxLaneKernels * clox_lane_kernels(void);
+
+// Forces the given kernels for the whole process, e.g. to compare them.
+// Returns false, leaving the selection alone, when this build or CPU doesn't
+// support them. Call it before starting any VMs, not while they're running.
+bool clox_lane_kernels_select(CloxLaneLevel level);
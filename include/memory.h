@@ -1,14 +1,73 @@
 #pragma once
 
+#include <stdio.h>
 #include <stddef.h>
 
+#include "config.h"
+
+// Where an allocation comes from, for the --mem-stats report.
+typedef enum CloxAllocSite {
+    CLOX_ALLOC_CHUNK_CODE,
+    CLOX_ALLOC_CHUNK_LINES,
+    CLOX_ALLOC_CONSTANTS,
+    CLOX_ALLOC_CONSTANT_INDEX,
+    CLOX_ALLOC_COMPACT_CHUNK,
+    CLOX_ALLOC_OPTIMIZER,
+    CLOX_ALLOC_ARENA,
+    CLOX_ALLOC_VM,
+    CLOX_ALLOC_IO,
+    CLOX_ALLOC_PROFILER,
+    CLOX_ALLOC_SITE_COUNT
+} CloxAllocSite;
+
+// Without CLOX_MEM_STATS the site is dropped here and nothing is recorded.
+#ifdef CLOX_MEM_STATS
+#define CLOX_REALLOCATE(site, previous, oldSize, newSize) \
+    clox_reallocate_tracked(site, previous, oldSize, newSize)
+#else
+#define CLOX_REALLOCATE(site, previous, oldSize, newSize) \
+    reallocate(previous, oldSize, newSize)
+#endif
+
 #define CLOX_GROW_CAPACITY(capacity) \
     ((capacity) < 8 ? 8 : (capacity) * 2)
 
-#define CLOX_GROW_ARRAY(previous, type, oldCount, count) \
-    (type *)reallocate(previous, sizeof(type) * (oldCount), sizeof(type) * (count))
+#define CLOX_GROW_ARRAY(site, previous, type, oldCount, count) \
+    (type *)CLOX_REALLOCATE(site, previous, sizeof(type) * (oldCount), sizeof(type) * (count))
+
+#define CLOX_FREE_ARRAY(site, type, pointer, oldCount) \
+    (type *)CLOX_REALLOCATE(site, pointer, sizeof(type) * (oldCount), 0);
+
+// Like CLOX_GROW_ARRAY, but allocates from `arena` unless it is NULL.
+#define CLOX_ARENA_GROW_ARRAY(arena, site, previous, type, oldCount, count) \
+    (type *)((arena) == NULL \
+        ? CLOX_REALLOCATE(site, previous, sizeof(type) * (oldCount), sizeof(type) * (count)) \
+        : clox_arena_reallocate(arena, previous, sizeof(type) * (oldCount), sizeof(type) * (count)))
 
-#define CLOX_FREE_ARRAY(type, pointer, oldCount) \
-    (type *)reallocate(pointer, sizeof(type) * (oldCount), 0);
+#define CLOX_ARENA_FREE_ARRAY(arena, site, type, pointer, oldCount) \
+    CLOX_ARENA_GROW_ARRAY(arena, site, pointer, type, oldCount, 0);
+
+typedef struct CloxArenaBlock CloxArenaBlock;
+
+// A bump allocator for data that is all released at once. Allocations are
+// never freed individually; growing the most recent one extends it in place
+// when its block has room, anything else is copied to a fresh allocation.
+typedef struct CloxArena CloxArena;
+struct CloxArena {
+    CloxArenaBlock *blocks;
+    void *last;
+};
 
 void *reallocate(void *previous, size_t oldSize, size_t newSize);
+
+#ifdef CLOX_MEM_STATS
+void *clox_reallocate_tracked(CloxAllocSite site, void *previous, size_t oldSize, size_t newSize);
+#endif
+
+// Prints what has been recorded so far. Builds without CLOX_MEM_STATS only
+// say that there is nothing to report.
+void clox_mem_stats_print(FILE * const out);
+
+void clox_arena_init(CloxArena * const arena);
+void *clox_arena_reallocate(CloxArena * const arena, void *previous, size_t oldSize, size_t newSize);
+void clox_arena_free(CloxArena * const arena);
@@ -0,0 +1,17 @@
+#pragma once
+
+// Converts a number literal as the scanner accepts it, digits with an optional
+// '.' and more digits, to the double nearest to it. `start` needn't be
+// terminated; only `length` characters are read. The result is the same as
+// strtod() gives in the C locale, whatever the current locale is.
+double clox_number_parse(const char * const start, int length);
+
+// Bytes clox_number_format() may write, including the terminating NUL.
+#define CLOX_NUMBER_FORMAT_MAX 32
+
+// Writes the shortest decimal that clox_number_parse() or strtod() reads back
+// as exactly `value`, picking the one nearest to it when there are several.
+// Numbers from 1e-6 up to 1e21 are written out in full ("0.001", "1500"), the
+// rest in exponent form ("1e+21", "2.5e-7"); also "inf", "-inf", "nan" and
+// "-0". The text is NUL-terminated and its length returned.
+int clox_number_format(double value, char * const buffer);
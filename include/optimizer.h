@@ -0,0 +1,5 @@
+#pragma once
+
+#include "chunk.h"
+
+void clox_optimize_chunk(CloxChunk * const chunk);
@@ -7,6 +7,16 @@ struct CloxOptions {
     bool help;
     bool version;
     bool verbose;
+    char *stack_max;
+    bool compile_only;
+    bool emit_c;
+    char *output;
+    char *inputs;
+    bool batch;
+    bool mem_stats;
+    bool profile;
+    bool printf_numbers;
+    bool jit;
     int index;
 };
 
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chunk.h"
+
+// The time stamp counter is far cheaper to read than any clock the C library
+// offers, which matters when it is read once per instruction.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define CLOX_PROFILE_RDTSC
+#define CLOX_PROFILE_CLOCK_UNIT "cycles"
+#else
+#include <time.h>
+#define CLOX_PROFILE_CLOCK_UNIT "ns"
+#endif
+
+// Execution totals for one opcode, source line or instruction.
+typedef struct CloxProfileCounter CloxProfileCounter;
+struct CloxProfileCounter {
+    uint64_t count;
+    uint64_t time;
+};
+
+// An instruction at a given offset and line, totalled over every chunk that
+// had it there.
+typedef struct CloxProfileHotspot CloxProfileHotspot;
+struct CloxProfileHotspot {
+    int line;
+    int offset;
+    uint8_t opcode;
+    CloxProfileCounter counter;
+};
+
+// What the VM's profiling run loop records. Each instruction is timed from
+// its dispatch to the next one, against its offset in the running chunk; at
+// the end of a run those per-offset counters are folded into the totals by
+// opcode, line and instruction that the report is made from.
+typedef struct CloxProfile CloxProfile;
+struct CloxProfile {
+    CloxProfileCounter *offsets;
+    int offset_capacity;
+    int last_offset;
+    uint64_t last_tick;
+
+    uint64_t runs;
+    CloxProfileCounter opcodes[UINT8_MAX + 1];
+    CloxProfileCounter *lines;
+    int line_capacity;
+    CloxProfileHotspot *hotspots;
+    int hotspot_count;
+    int hotspot_capacity;
+};
+
+static inline uint64_t clox_profile_clock(void) {
+#ifdef CLOX_PROFILE_RDTSC
+    return __rdtsc();
+#else
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Called by the VM right before dispatching the instruction at `offset`.
+static inline void clox_profile_tick(CloxProfile * const profile, int offset) {
+    uint64_t now = clox_profile_clock();
+
+    if (profile->last_offset >= 0) {
+        profile->offsets[profile->last_offset].time += now - profile->last_tick;
+    }
+
+    profile->offsets[offset].count++;
+    profile->last_offset = offset;
+    profile->last_tick = now;
+}
+
+CloxProfile * clox_profile_new();
+void clox_profile_begin_run(CloxProfile * const profile, const CloxChunk * const chunk);
+void clox_profile_end_run(CloxProfile * const profile, const CloxChunk * const chunk);
+void clox_profile_print(const CloxProfile * const profile, FILE * const out);
+void clox_profile_free(CloxProfile * const profile);
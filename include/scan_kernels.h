@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Loops the scanner spends most of its time in, each skipping a run of one
+// kind of character. They take a pointer into NUL-terminated text and return
+// a pointer to the first byte that doesn't belong to the run; the NUL never
+// does, so a run can't go past the end of the text.
+typedef struct CloxScanKernels CloxScanKernels;
+struct CloxScanKernels {
+    const char *name;
+
+    // ' ', '\t', '\r' and '\n', adding the newlines skipped to `line`.
+    const char * (*whitespace)(const char *text, int *line);
+    // Anything up to the '\n' that ends a comment.
+    const char * (*comment)(const char *text);
+    // Anything up to the closing '"' of a string, adding newlines to `line`.
+    const char * (*string)(const char *text, int *line);
+    // Letters, digits and '_'.
+    const char * (*identifier)(const char *text);
+    // Decimal digits.
+    const char * (*digits)(const char *text);
+};
+
+typedef enum CloxScanLevel {
+    CLOX_SCAN_SCALAR,
+    CLOX_SCAN_SSE2,
+    CLOX_SCAN_AVX2,
+    CLOX_SCAN_LEVEL_COUNT
+} CloxScanLevel;
+
+// The widest kernels the CPU supports, picked on first use. Safe to call from
+// any thread.
+const CloxScanKernels * clox_scan_kernels(void);
+
+// Forces the given kernels for the whole process, e.g. to compare them.
+// Returns false, leaving the selection alone, when this build or CPU doesn't
+// support them. Call it before starting any VMs, not while they're running.
+bool clox_scan_kernels_select(CloxScanLevel level);
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "keywords.h"
+#include "scan_kernels.h"
+
 typedef enum CloxtokenType {
     // Single-character tokens.
     TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
@@ -7,7 +13,8 @@ typedef enum CloxtokenType {
     TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
     TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
 
-    // One or two character tokens.
+    // One or two character tokens; the scanner relies on each one being
+    // followed by its form with '='.
     TOKEN_BANG, TOKEN_BANG_EQUAL,
     TOKEN_EQUAL, TOKEN_EQUAL_EQUAL,
     TOKEN_GREATER, TOKEN_GREATER_EQUAL,
@@ -16,11 +23,8 @@ typedef enum CloxtokenType {
     // Literals.
     TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
 
-    // Keywords.
-    TOKEN_AND, TOKEN_CLASS, TOKEN_ELSE, TOKEN_FALSE,
-    TOKEN_FUN, TOKEN_FOR, TOKEN_IF, TOKEN_NIL, TOKEN_OR,
-    TOKEN_PRINT, TOKEN_RETURN, TOKEN_SUPER, TOKEN_THIS,
-    TOKEN_TRUE, TOKEN_VAR, TOKEN_WHILE,
+    // Keywords, generated from src/keywords.txt.
+    CLOX_KEYWORD_TOKENS
 
     TOKEN_ERROR,
     TOKEN_EOF
@@ -34,5 +38,35 @@ struct CloxToken {
     int line;
 };
 
-void clox_scanner_init(const char * const source);
-CloxToken clox_scanner_scan_token();
+// The parser holds on to the previous and current token, so in stream mode
+// that many lexemes have to outlive the window they were scanned from.
+#define CLOX_SCANNER_LEXEMES 2
+
+typedef struct CloxScannerLexeme CloxScannerLexeme;
+struct CloxScannerLexeme {
+    char *text;
+    int capacity;
+};
+
+typedef struct CloxScanner CloxScanner;
+struct CloxScanner {
+    const char *start;
+    const char *current;
+    int line;
+    const CloxScanKernels *kernels;
+
+    // Stream mode only: input is read from `fd` into a sliding window that
+    // always ends in a NUL, and token lexemes are copied out of it.
+    int fd;
+    bool eof;
+    char *window;
+    size_t window_count;
+    size_t window_capacity;
+    CloxScannerLexeme lexemes[CLOX_SCANNER_LEXEMES];
+    int next_lexeme;
+};
+
+void clox_scanner_init(CloxScanner * const scanner, const char * const source);
+void clox_scanner_init_stream(CloxScanner * const scanner, int fd);
+void clox_scanner_free(CloxScanner * const scanner);
+CloxToken clox_scanner_scan_token(CloxScanner * const scanner);
@@ -1,14 +1,104 @@
 #pragma once
 
-typedef double CloxValue;
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "memory.h"
+#include "number.h"
+
+// Values are NaN-boxed into 64 bits. A number is stored as the bits of its
+// double. Anything else sets all the bits of QNAN, which makes it a quiet NaN
+// with the extra bit 50 set; no arithmetic on numbers produces such a NaN, so
+// these bit patterns are free. The low bits then say what the value is.
+typedef uint64_t CloxValue;
+
+_Static_assert(sizeof(double) == sizeof(CloxValue), "numbers are stored in values bit for bit");
+
+#define CLOX_QNAN UINT64_C(0x7ffc000000000000)
+
+#define CLOX_TAG_NIL 1
+#define CLOX_TAG_FALSE 2
+#define CLOX_TAG_TRUE 3
+
+#define CLOX_NIL_VAL ((CloxValue)(CLOX_QNAN | CLOX_TAG_NIL))
+#define CLOX_FALSE_VAL ((CloxValue)(CLOX_QNAN | CLOX_TAG_FALSE))
+#define CLOX_TRUE_VAL ((CloxValue)(CLOX_QNAN | CLOX_TAG_TRUE))
+#define CLOX_BOOL_VAL(b) ((b) ? CLOX_TRUE_VAL : CLOX_FALSE_VAL)
+#define CLOX_NUMBER_VAL(number) clox_value_from_number(number)
+
+#define CLOX_IS_NUMBER(value) (((value) & CLOX_QNAN) != CLOX_QNAN)
+#define CLOX_IS_NIL(value) ((value) == CLOX_NIL_VAL)
+// FALSE and TRUE only differ in the lowest bit.
+#define CLOX_IS_BOOL(value) (((value) | 1) == CLOX_TRUE_VAL)
+
+#define CLOX_AS_NUMBER(value) clox_value_to_number(value)
+#define CLOX_AS_BOOL(value) ((value) == CLOX_TRUE_VAL)
+
+static inline CloxValue clox_value_from_number(double number) {
+    CloxValue value;
+    memcpy(&value, &number, sizeof(value));
+    return value;
+}
+
+static inline double clox_value_to_number(CloxValue value) {
+    double number;
+    memcpy(&number, &value, sizeof(number));
+    return number;
+}
+
+// The one NaN that numbers crossing the API are given, see
+// clox_value_canonical().
+#define CLOX_CANONICAL_NAN UINT64_C(0x7ff8000000000000)
+
+// A number crossing the API as a plain double, such as an input or a result
+// of clox_vm_evaluate(), with any NaN made the canonical one. On the way in
+// that keeps a payload from passing for a tag; on the way out it hides which
+// NaN an operation on two of them picked, which x86 leaves to operand order
+// and so to the compiler.
+static inline CloxValue clox_value_canonical(double number) {
+    return number == number ? clox_value_from_number(number) : CLOX_CANONICAL_NAN;
+}
+
+// Whether `value` is a number or one of the tagged values above, for checking
+// values that come from outside, such as bytecode files.
+static inline bool clox_value_is_valid(CloxValue value) {
+    return CLOX_IS_NUMBER(value) || CLOX_IS_NIL(value) || CLOX_IS_BOOL(value);
+}
+
+// When `arena` is set the values live in it and are released along with it.
 typedef struct CloxValueArray CloxValueArray;
 struct CloxValueArray {
     int capacity;
     int count;
     CloxValue *values;
+    CloxArena *arena;
 };
 
+// Open-addressing hash index over the values of a CloxValueArray, used to
+// find an existing slot holding a value without scanning the array. Values are
+// matched on their exact bit pattern, so -0.0 is kept apart from 0.0 and a NaN
+// only ever matches a NaN with the same payload.
+typedef struct CloxValueIndex CloxValueIndex;
+struct CloxValueIndex {
+    int capacity;
+    int count;
+    int *slots;
+};
+
+typedef enum CloxNumberFormat {
+    // The shortest text that reads back as the same number.
+    CLOX_NUMBER_FORMAT_SHORTEST,
+    // printf's "%g", six significant digits, as older versions printed.
+    CLOX_NUMBER_FORMAT_PRINTF
+} CloxNumberFormat;
+
+// Bytes clox_value_format() may write, including the terminating NUL.
+#define CLOX_VALUE_FORMAT_MAX CLOX_NUMBER_FORMAT_MAX
+
+// Writes `value` to `buffer` as NUL-terminated text and returns its length.
+int clox_value_format(CloxValue value, CloxNumberFormat format, char * const buffer);
+
 void clox_value_print(CloxValue value);
 
 void clox_valuearray_init(CloxValueArray * const array);
@@ -16,3 +106,13 @@ void clox_valuearray_init(CloxValueArray * const array);
 void clox_valuearray_write(CloxValueArray * const array, CloxValue value);
 
 void clox_valuearray_free(CloxValueArray * const array);
+
+void clox_valueindex_init(CloxValueIndex * const index);
+
+int clox_valueindex_find(const CloxValueIndex * const index, const CloxValueArray * const array, CloxValue value);
+
+void clox_valueindex_insert(CloxValueIndex * const index, const CloxValueArray * const array, int slot);
+
+void clox_valueindex_remove(CloxValueIndex * const index, const CloxValueArray * const array, int slot);
+
+void clox_valueindex_free(CloxValueIndex * const index);
@@ -1,11 +1,25 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include "chunk.h"
+#include "profile.h"
 #include "value.h"
 
-#define CLOX_VM_STACK_MAX 256
+// Upper bound on the number of stack slots unless set otherwise through
+// clox_vm_set_stack_max(). The stack starts out at CLOX_VM_STACK_INITIAL slots
+// (see config.h) and doubles whenever a chunk needs more.
+#define CLOX_VM_STACK_MAX_DEFAULT (1024 * 1024)
+
+// Size of the buffer results are collected in before being written out.
+#define CLOX_VM_OUTPUT_SIZE (64 * 1024)
+
+// Runs after which `clox --jit` compiles a chunk to native code. Compiling
+// costs as much as a few hundred runs of a short expression.
+#define CLOX_VM_JIT_HOT_RUNS 1000
 
 typedef enum CloxInterpretResult {
     INTERPRET_OK,
@@ -13,16 +27,63 @@ typedef enum CloxInterpretResult {
     INTERPRET_RUNTIME_ERROR
 } CloxInterpretResult;
 
+// Every result the VM prints is formatted into `buffer`, which is written to
+// `stream` when it fills up and at the end of each run. When `batching`, runs
+// leave it alone and it is only written out when full or by clox_vm_flush().
+typedef struct CloxVMOutput CloxVMOutput;
+struct CloxVMOutput {
+    FILE *stream;
+    char *buffer;
+    size_t count;
+    bool batching;
+    CloxNumberFormat number_format;
+};
+
 typedef struct CloxVM CloxVM;
 struct CloxVM {
     CloxChunk *chunk;
     uint8_t *ip;
-    CloxValue stack[CLOX_VM_STACK_MAX];
+    CloxValue *stack;
     CloxValue *stack_top;
+    CloxValue *stack_end;
+    size_t stack_max;
+    CloxProfile *profile;
+    CloxVMOutput output;
+
+    // Chunks are compiled to native code on their jit_hot_runs'th run, see
+    // clox_vm_set_jit(); 0 leaves everything to the interpreter.
+    int jit_hot_runs;
+
+    // Set for the duration of clox_vm_evaluate(): the values OP_INPUT reads
+    // and where OP_RETURN stores the result instead of printing it.
+    const double *inputs;
+    CloxValue *result;
+
+    // The rows of clox_vm_run_lanes()'s stack, kept between calls.
+    double *lanes;
+    size_t lanes_capacity;
 };
 
-void clox_vm_init();
-CloxInterpretResult clox_vm_interpret(const char * const source);
-void clox_vm_stack_push(CloxValue value);
-CloxValue clox_vm_stack_pop();
-void clox_vm_free();
+// A VM owns all state needed to compile and run code, so separate VMs can be
+// used from separate threads at the same time. A chunk isn't part of that:
+// with the JIT on, running it counts its runs and stores its native code in
+// it, so it mustn't be run by VMs on different threads at the same time.
+CloxVM * clox_vm_new();
+void clox_vm_set_stack_max(CloxVM * const vm, size_t slots);
+void clox_vm_set_profile(CloxVM * const vm, CloxProfile * const profile);
+void clox_vm_set_number_format(CloxVM * const vm, CloxNumberFormat format);
+void clox_vm_set_output_batching(CloxVM * const vm, bool batching);
+void clox_vm_set_jit(CloxVM * const vm, int hot_runs);
+void clox_vm_flush(CloxVM * const vm);
+CloxInterpretResult clox_vm_interpret(CloxVM * const vm, const char * const source);
+CloxInterpretResult clox_vm_interpret_chunk(CloxVM * const vm, CloxChunk * const chunk);
+CloxInterpretResult clox_vm_evaluate(CloxVM * const vm, CloxChunk * const chunk, const double * const inputs, CloxValue * const result);
+CloxInterpretResult clox_vm_run_lanes(
+    CloxVM * const vm,
+    CloxChunk * const chunk,
+    const double * const * const inputs,
+    size_t count,
+    double * const results);
+bool clox_vm_stack_push(CloxVM * const vm, CloxValue value);
+CloxValue clox_vm_stack_pop(CloxVM * const vm);
+void clox_vm_free(CloxVM * const vm);
@@ -0,0 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bytecode.h"
+#include "chunk.h"
+#include "jit.h"
+#include "value.h"
+
+#define BYTE_ORDER_MARK UINT32_C(0x01020304)
+
+// On-disk layout: this header, then the constant pool, the line table and the
+// code, each at the offset recorded here. Sections are aligned so that the
+// loaded chunk can point into the mapped file directly.
+typedef struct CloxBytecodeHeader CloxBytecodeHeader;
+struct CloxBytecodeHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t value_size;
+    uint32_t byte_order;
+    uint32_t max_stack;
+    uint32_t constant_count;
+    uint32_t constants_offset;
+    uint32_t line_count;
+    uint32_t lines_offset;
+    uint32_t code_count;
+    uint32_t code_offset;
+    uint32_t input_count;
+    // Keeps the constants that follow aligned; always zero.
+    uint32_t reserved;
+};
+
+_Static_assert(sizeof(CloxBytecodeHeader) == 48, "bytecode header must not have padding");
+_Static_assert(sizeof(CloxLineRun) == 8, "line runs are stored as two 32-bit integers");
+
+static bool read_error(const char * const path, const char * const reason) {
+    fprintf(stderr, "Invalid bytecode file \"%s\": %s.\n", path, reason);
+    return false;
+}
+
+// Whether `count` items of `size` bytes starting at `offset` lie within the
+// file, starting no earlier than `start` and aligned to `align` bytes.
+static bool section_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t align, uint64_t start, uint64_t file_size) {
+    return offset >= start
+        && offset % align == 0
+        && offset <= file_size
+        && count * size <= file_size - offset;
+}
+
+// Only regular files are sniffed: reading the magic from a pipe would eat the
+// start of a script that then gets read as source.
+bool clox_bytecode_is_image(const char * const path) {
+    struct stat info;
+
+    if (stat(path, &info) == -1 || !S_ISREG(info.st_mode)) {
+        return false;
+    }
+
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        return false;
+    }
+
+    char magic[4];
+    bool isImage = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && memcmp(magic, CLOX_BYTECODE_MAGIC, sizeof(magic)) == 0;
+
+    fclose(file);
+    return isImage;
+}
+
+bool clox_bytecode_write(const CloxChunk * const chunk, const char * const path) {
+    CloxBytecodeHeader header;
+    memcpy(header.magic, CLOX_BYTECODE_MAGIC, sizeof(header.magic));
+    header.version = CLOX_BYTECODE_VERSION;
+    header.value_size = sizeof(CloxValue);
+    header.byte_order = BYTE_ORDER_MARK;
+    header.max_stack = (uint32_t)chunk->max_stack;
+    header.constant_count = (uint32_t)chunk->constants.count;
+    header.constants_offset = sizeof(header);
+    header.line_count = (uint32_t)chunk->line_count;
+    header.lines_offset = header.constants_offset + header.constant_count * sizeof(CloxValue);
+    header.code_count = (uint32_t)chunk->count;
+    header.code_offset = header.lines_offset + header.line_count * sizeof(CloxLineRun);
+    header.input_count = (uint32_t)chunk->input_count;
+    header.reserved = 0;
+
+    FILE *file = fopen(path, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open \"%s\" for writing.\n", path);
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(chunk->constants.values, sizeof(CloxValue), chunk->constants.count, file) == (size_t)chunk->constants.count
+        && fwrite(chunk->lines, sizeof(CloxLineRun), chunk->line_count, file) == (size_t)chunk->line_count
+        && fwrite(chunk->code, 1, chunk->count, file) == (size_t)chunk->count;
+
+    if (fclose(file) != 0 || !written) {
+        fprintf(stderr, "Failed to write bytecode to \"%s\".\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static bool validate(const CloxBytecodeImage * const image, const char * const path) {
+    const uint8_t * const base = (const uint8_t *)image->mapping;
+    CloxBytecodeHeader header;
+
+    if (image->size < sizeof(header)) {
+        return read_error(path, "file is truncated");
+    }
+
+    memcpy(&header, base, sizeof(header));
+
+    if (memcmp(header.magic, CLOX_BYTECODE_MAGIC, sizeof(header.magic)) != 0) {
+        return read_error(path, "not a clox bytecode file");
+    }
+
+    if (header.version != CLOX_BYTECODE_VERSION) {
+        return read_error(path, "written by an incompatible version of clox, recompile it");
+    }
+
+    if (header.value_size != sizeof(CloxValue) || header.byte_order != BYTE_ORDER_MARK) {
+        return read_error(path, "written on an incompatible platform");
+    }
+
+    if (!section_fits(header.constants_offset, header.constant_count, sizeof(CloxValue), sizeof(CloxValue), sizeof(header), image->size)
+            || !section_fits(header.lines_offset, header.line_count, sizeof(CloxLineRun), sizeof(int), header.constants_offset + (uint64_t)header.constant_count * sizeof(CloxValue), image->size)
+            || !section_fits(header.code_offset, header.code_count, 1, 1, header.lines_offset + (uint64_t)header.line_count * sizeof(CloxLineRun), image->size)) {
+        return read_error(path, "file is truncated or its sections are out of bounds");
+    }
+
+    if (header.code_count > INT32_MAX
+            || header.line_count > INT32_MAX
+            || header.constant_count > UINT16_MAX + 1u
+            || header.input_count > CLOX_CHUNK_MAX_INPUTS
+            || header.reserved != 0) {
+        return read_error(path, "header fields are out of range");
+    }
+
+    return true;
+}
+
+static bool validate_chunk(const CloxChunk * const chunk, const char * const path) {
+    int max_stack = clox_chunk_compute_max_stack(chunk);
+
+    if (max_stack < 0) {
+        return read_error(path, "code is malformed");
+    }
+
+    if (max_stack != chunk->max_stack) {
+        return read_error(path, "recorded stack depth does not match the code");
+    }
+
+    for (int i = 0; i < chunk->constants.count; i++) {
+        if (!clox_value_is_valid(chunk->constants.values[i])) {
+            return read_error(path, "constant pool holds an invalid value");
+        }
+    }
+
+    if (chunk->line_count == 0 || chunk->lines[0].offset != 0) {
+        return read_error(path, "line table is corrupt");
+    }
+
+    for (int i = 1; i < chunk->line_count; i++) {
+        if (chunk->lines[i].offset <= chunk->lines[i - 1].offset || chunk->lines[i].offset >= chunk->count) {
+            return read_error(path, "line table is corrupt");
+        }
+    }
+
+    return true;
+}
+
+bool clox_bytecode_load(CloxBytecodeImage * const image, const char * const path) {
+    image->mapping = NULL;
+    image->size = 0;
+    clox_chunk_init(&image->chunk);
+
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open \"%s\" for reading.\n", path);
+        return false;
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) == -1 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return read_error(path, "not a regular, non-empty file");
+    }
+
+    void *mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "Failed to map \"%s\" into memory.\n", path);
+        return false;
+    }
+
+    image->mapping = mapping;
+    image->size = (size_t)info.st_size;
+
+    if (!validate(image, path)) {
+        clox_bytecode_unload(image);
+        return false;
+    }
+
+    CloxBytecodeHeader header;
+    memcpy(&header, mapping, sizeof(header));
+
+    uint8_t * const base = (uint8_t *)mapping;
+    CloxChunk * const chunk = &image->chunk;
+
+    chunk->count = (int)header.code_count;
+    chunk->code = base + header.code_offset;
+    chunk->line_count = (int)header.line_count;
+    chunk->lines = (CloxLineRun *)(base + header.lines_offset);
+    chunk->constants.count = (int)header.constant_count;
+    chunk->constants.values = (CloxValue *)(base + header.constants_offset);
+    chunk->max_stack = (int)header.max_stack;
+    chunk->input_count = (int)header.input_count;
+
+    if (!validate_chunk(chunk, path)) {
+        clox_bytecode_unload(image);
+        return false;
+    }
+
+    return true;
+}
+
+void clox_bytecode_unload(CloxBytecodeImage * const image) {
+    // Native code is the one part of the chunk outside the mapping.
+    clox_jit_free(image->chunk.jit);
+
+    if (image->mapping != NULL) {
+        munmap(image->mapping, image->size);
+    }
+
+    image->mapping = NULL;
+    image->size = 0;
+    clox_chunk_init(&image->chunk);
+}
@@ -1,43 +1,338 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "chunk.h"
+#include "jit.h"
 #include "memory.h"
 
 void clox_chunk_init(CloxChunk * const chunk) {
     chunk->capacity = 0;
     chunk->count = 0;
     chunk->code = NULL;
-    chunk->line_numbers = NULL;
+    chunk->line_count = 0;
+    chunk->line_capacity = 0;
+    chunk->lines = NULL;
     clox_valuearray_init(&chunk->constants);
+    clox_valueindex_init(&chunk->constant_index);
+    chunk->max_stack = 0;
+    chunk->input_count = 0;
+    chunk->jit = NULL;
+    chunk->jit_spare = NULL;
+    chunk->jit_runs = 0;
+    chunk->arena = NULL;
+    chunk->block = NULL;
+}
+
+// Starts a chunk whose arrays are allocated from `arena`. They are released
+// with the arena, so freeing the chunk itself gives nothing back.
+void clox_chunk_init_arena(CloxChunk * const chunk, CloxArena * const arena) {
+    clox_chunk_init(chunk);
+    chunk->arena = arena;
+    chunk->constants.arena = arena;
+}
+
+// The native code no longer matches the chunk. Its mapping is set aside, so
+// compiling the chunk again doesn't have to map a new one.
+static void drop_jit(CloxChunk * const chunk) {
+    if (chunk->jit != NULL) {
+        clox_jit_free(chunk->jit_spare);
+        chunk->jit_spare = chunk->jit;
+        chunk->jit = NULL;
+    }
+
+    chunk->jit_runs = 0;
+}
+
+static void write_line(CloxChunk * const chunk, int offset, int line) {
+    if (chunk->line_count > 0 && chunk->lines[chunk->line_count - 1].line == line) {
+        return;
+    }
+
+    if (chunk->line_capacity < chunk->line_count + 1) {
+        int oldCapacity = chunk->line_capacity;
+        chunk->line_capacity = CLOX_GROW_CAPACITY(chunk->line_capacity);
+        chunk->lines = CLOX_ARENA_GROW_ARRAY(
+            chunk->arena,
+            CLOX_ALLOC_CHUNK_LINES,
+            chunk->lines,
+            CloxLineRun,
+            oldCapacity,
+            chunk->line_capacity);
+    }
+
+    CloxLineRun *run = &chunk->lines[chunk->line_count++];
+    run->offset = offset;
+    run->line = line;
 }
 
 void clox_chunk_write(CloxChunk * const chunk, uint8_t byte, int line) {
+    if (chunk->jit_runs != 0) {
+        drop_jit(chunk);
+    }
+
     if (chunk->capacity < chunk->count + 1) {
         int oldCapacity = chunk->capacity;
         chunk->capacity = CLOX_GROW_CAPACITY(chunk->capacity);
-        chunk->code = CLOX_GROW_ARRAY(
+        chunk->code = CLOX_ARENA_GROW_ARRAY(
+            chunk->arena,
+            CLOX_ALLOC_CHUNK_CODE,
             chunk->code,
             uint8_t,
             oldCapacity,
             chunk->capacity);
-        chunk->line_numbers = CLOX_GROW_ARRAY(
-            chunk->line_numbers,
-            int,
-            oldCapacity,
-            chunk->capacity);
     }
 
-    chunk->code[chunk->count] = byte;
-    chunk->line_numbers[chunk->count++] = line;
+    write_line(chunk, chunk->count, line);
+    chunk->code[chunk->count++] = byte;
+}
+
+static size_t compacted_size(const CloxChunk * const chunk) {
+    return sizeof(CloxValue) * (size_t)chunk->constants.count
+        + sizeof(CloxLineRun) * (size_t)chunk->line_count
+        + (size_t)chunk->count;
 }
 
 void clox_chunk_free(CloxChunk * const chunk) {
-    clox_valuearray_free(&chunk->constants);
-    CLOX_FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
-    CLOX_FREE_ARRAY(int, chunk->line_numbers, chunk->capacity);
+    clox_valueindex_free(&chunk->constant_index);
+    clox_jit_free(chunk->jit);
+    clox_jit_free(chunk->jit_spare);
+
+    if (chunk->block != NULL) {
+        CLOX_REALLOCATE(CLOX_ALLOC_COMPACT_CHUNK, chunk->block, compacted_size(chunk), 0);
+    } else {
+        clox_valuearray_free(&chunk->constants);
+        CLOX_ARENA_FREE_ARRAY(chunk->arena, CLOX_ALLOC_CHUNK_CODE, uint8_t, chunk->code, chunk->capacity);
+        CLOX_ARENA_FREE_ARRAY(chunk->arena, CLOX_ALLOC_CHUNK_LINES, CloxLineRun, chunk->lines, chunk->line_capacity);
+    }
+
     clox_chunk_init(chunk);
 }
 
+// Copies the finished chunk into a single heap block, constants first, then the
+// line table and the code, so that what run() reads sits together in memory
+// and the chunk no longer depends on the arena it was built in, if any. The
+// chunk is read-only afterwards.
+void clox_chunk_compact(CloxChunk * const chunk) {
+    if (chunk->block != NULL || chunk->count == 0) {
+        return;
+    }
+
+    size_t constantsSize = sizeof(CloxValue) * (size_t)chunk->constants.count;
+    size_t linesSize = sizeof(CloxLineRun) * (size_t)chunk->line_count;
+    size_t codeSize = (size_t)chunk->count;
+
+    unsigned char * const block = (unsigned char *)CLOX_REALLOCATE(CLOX_ALLOC_COMPACT_CHUNK, NULL, 0, compacted_size(chunk));
+
+    CloxValue * const constants = (CloxValue *)block;
+    CloxLineRun * const lines = (CloxLineRun *)(block + constantsSize);
+    uint8_t * const code = block + constantsSize + linesSize;
+
+    memcpy(constants, chunk->constants.values, constantsSize);
+    memcpy(lines, chunk->lines, linesSize);
+    memcpy(code, chunk->code, codeSize);
+
+    CloxChunk compacted = *chunk;
+    clox_valueindex_init(&compacted.constant_index);
+    compacted.code = code;
+    compacted.capacity = chunk->count;
+    compacted.lines = lines;
+    compacted.line_capacity = chunk->line_count;
+    compacted.constants.values = constants;
+    compacted.constants.capacity = chunk->constants.count;
+    compacted.constants.arena = NULL;
+    compacted.arena = NULL;
+    compacted.block = block;
+
+    // The native code doesn't point into the chunk's arrays, so it moves over.
+    chunk->jit = NULL;
+    chunk->jit_spare = NULL;
+    clox_chunk_free(chunk);
+    *chunk = compacted;
+}
+
+// Empties the chunk but keeps its buffers, for compiling many small programs
+// one after the other into the same chunk.
+void clox_chunk_reset(CloxChunk * const chunk) {
+    chunk->count = 0;
+    chunk->line_count = 0;
+    chunk->constants.count = 0;
+    clox_valueindex_free(&chunk->constant_index);
+    chunk->max_stack = 0;
+    chunk->input_count = 0;
+    drop_jit(chunk);
+}
+
+void clox_chunk_truncate(CloxChunk * const chunk, int count) {
+    if (count >= chunk->count) {
+        return;
+    }
+
+    chunk->count = count;
+    drop_jit(chunk);
+
+    while (chunk->line_count > 0 && chunk->lines[chunk->line_count - 1].offset >= count) {
+        chunk->line_count--;
+    }
+}
+
+// Whether the chunk only ever deals in numbers. Inputs are numbers, so any
+// other value has to come from a literal in the code.
+bool clox_chunk_numbers_only(const CloxChunk * const chunk) {
+    for (int i = 0; i < chunk->constants.count; i++) {
+        if (!CLOX_IS_NUMBER(chunk->constants.values[i])) {
+            return false;
+        }
+    }
+
+    for (int offset = 0; offset < chunk->count;) {
+        switch (chunk->code[offset]) {
+            case OP_NIL:
+            case OP_TRUE:
+            case OP_FALSE:
+                return false;
+
+            case OP_CONSTANT_LONG:
+                offset += 3;
+                break;
+
+            case OP_CONSTANT:
+            case OP_INPUT:
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT:
+                offset += 2;
+                break;
+
+            default:
+                offset++;
+                break;
+        }
+    }
+
+    return true;
+}
+
+int clox_chunk_get_line(const CloxChunk * const chunk, int offset) {
+    // Find the last run starting at or before the offset.
+    int low = 0;
+    int high = chunk->line_count - 1;
+    int line = -1;
+
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+
+        if (chunk->lines[mid].offset <= offset) {
+            line = chunk->lines[mid].line;
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return line;
+}
+
+// Walks the code and returns the largest number of values it ever has on the
+// stack at once, or -1 if it is malformed: unknown opcodes, operands running
+// off the end, constant or input indices out of range, popping an empty stack
+// or reaching the end of the code without returning.
+int clox_chunk_compute_max_stack(const CloxChunk * const chunk) {
+    int depth = 0;
+    int max = 0;
+    uint8_t last = OP_CONSTANT;
+
+    for (int offset = 0; offset < chunk->count;) {
+        int operand_size = 0;
+        int pops = 0;
+        int pushes = 0;
+
+        switch (last = chunk->code[offset]) {
+            case OP_CONSTANT:
+                operand_size = 1;
+                pushes = 1;
+                break;
+
+            case OP_CONSTANT_LONG:
+                operand_size = 2;
+                pushes = 1;
+                break;
+
+            case OP_NIL:
+            case OP_TRUE:
+            case OP_FALSE:
+                pushes = 1;
+                break;
+
+            case OP_INPUT:
+                operand_size = 1;
+                pushes = 1;
+                break;
+
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT:
+                operand_size = 1;
+                pops = 1;
+                pushes = 1;
+                break;
+
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+                pops = 2;
+                pushes = 1;
+                break;
+
+            case OP_NEGATE:
+                pops = 1;
+                pushes = 1;
+                break;
+
+            case OP_RETURN:
+                pops = 1;
+                break;
+
+            default:
+                return -1;
+        }
+
+        if (offset + operand_size >= chunk->count) {
+            return -1;
+        }
+
+        if (operand_size > 0) {
+            int index = chunk->code[offset + 1];
+
+            if (operand_size == 2) {
+                index = (index << 8) | chunk->code[offset + 2];
+            }
+
+            int limit = last == OP_INPUT ? chunk->input_count : chunk->constants.count;
+
+            if (index >= limit) {
+                return -1;
+            }
+        }
+
+        if (depth < pops) {
+            return -1;
+        }
+
+        depth += pushes - pops;
+
+        if (depth > max) {
+            max = depth;
+        }
+
+        offset += 1 + operand_size;
+    }
+
+    return last == OP_RETURN ? max : -1;
+}
+
 void clox_chunk_write_constant(CloxChunk * const chunk, int index, int line) {
     uint8_t opcode = index > UINT8_MAX ? OP_CONSTANT_LONG : OP_CONSTANT;
     clox_chunk_write(chunk, opcode, line);
@@ -50,6 +345,37 @@ void clox_chunk_write_constant(CloxChunk * const chunk, int index, int line) {
 }
 
 int clox_chunk_add_constant(CloxChunk * const chunk, CloxValue value) {
+    CloxValueIndex * const index = &chunk->constant_index;
+
+    // The index may have been dropped after compilation, bring it back up to
+    // date before relying on it.
+    for (int i = index->count; i < chunk->constants.count; i++) {
+        clox_valueindex_insert(index, &chunk->constants, i);
+    }
+
+    int existing = clox_valueindex_find(index, &chunk->constants, value);
+
+    if (existing != -1) {
+        return existing;
+    }
+
     clox_valuearray_write(&chunk->constants, value);
+    clox_valueindex_insert(index, &chunk->constants, chunk->constants.count - 1);
     return chunk->constants.count - 1;
 }
+
+void clox_chunk_truncate_constants(CloxChunk * const chunk, int count) {
+    CloxValueIndex * const index = &chunk->constant_index;
+
+    while (chunk->constants.count > count) {
+        int slot = --chunk->constants.count;
+
+        if (slot < index->count) {
+            clox_valueindex_remove(index, &chunk->constants, slot);
+        }
+    }
+}
+
+void clox_chunk_free_constant_index(CloxChunk * const chunk) {
+    clox_valueindex_free(&chunk->constant_index);
+}
@@ -1,22 +1,25 @@
 #include <stdint.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 #include "compiler.h"
 #include "config.h"
 #include "scanner.h"
 #include "chunk.h"
+#include "number.h"
+#include "optimizer.h"
 #include "value.h"
 
 #ifdef CLOX_DEBUG_PRINT_CODE
-#include "clox_debug.h"
+#include "debug.h"
 #endif
 
 #define BYTES(...) ((uint8_t[]){__VA_ARGS__})
 #define MAX_NUM_CONSTANTS UINT16_MAX
 
-typedef void (*CloxParseFunc)();
+typedef struct CloxCompiler CloxCompiler;
+
+typedef void (*CloxParseFunc)(CloxCompiler * const compiler);
 
 typedef enum CloxPrecedence {
     PRECEDENCE_NONE,
@@ -45,90 +48,96 @@ struct CloxParser {
     CloxToken previous;
     bool had_error;
     bool panic_mode;
-} parser;
+};
+
+// The most recently emitted constant load, used to tell whether an operand
+// compiled down to nothing but a constant and can therefore be folded. Only
+// number literals and folds of them are loaded from the constant pool.
+typedef struct CloxConstantOperand CloxConstantOperand;
+struct CloxConstantOperand {
+    int start;
+    int end;
+    int constants_before;
+    double value;
+};
 
-static CloxChunk * current_chunk();
+// Everything a single compilation works on. It lives on the stack of
+// clox_compiler_compile, so compilations on different threads share nothing.
+struct CloxCompiler {
+    CloxScanner scanner;
+    CloxParser parser;
+    CloxChunk *chunk;
+    CloxConstantOperand last_constant;
+    const char * const *inputs;
+    int input_count;
+    int depth;
+};
+
+static CloxChunk * current_chunk(CloxCompiler * const compiler);
 
-static void error_at(const CloxToken * const token, const char * const message);
-static void error(const char * const message);
-static void error_at_current(const char * const message);
+static void error_at(CloxCompiler * const compiler, const CloxToken * const token, const char * const message);
+static void error(CloxCompiler * const compiler, const char * const message);
+static void error_at_current(CloxCompiler * const compiler, const char * const message);
 
-static void advance();
-static void consume(CloxTokenType type, const char * const message);
-static uint16_t make_constant(CloxValue value);
+static void advance(CloxCompiler * const compiler);
+static void consume(CloxCompiler * const compiler, CloxTokenType type, const char * const message);
+static uint16_t make_constant(CloxCompiler * const compiler, CloxValue value);
 
-static void emit_byte(uint8_t byte);
-static void emit_bytes(size_t len, const uint8_t * const bytes);
-static void emit_return();
-static void emit_constant(CloxValue value);
+static void emit_byte(CloxCompiler * const compiler, uint8_t byte);
+static void emit_bytes(CloxCompiler * const compiler, size_t len, const uint8_t * const bytes);
+static void emit_return(CloxCompiler * const compiler);
+static void emit_constant(CloxCompiler * const compiler, double value);
 
-static void end_compiler();
+static bool last_constant_operand(CloxCompiler * const compiler, CloxConstantOperand * const operand);
+static void fold_constant(CloxCompiler * const compiler, const CloxConstantOperand * const first, double value);
 
-static void parse_precedence(CloxPrecedence precedence);
+static void end_compiler(CloxCompiler * const compiler);
+
+static void parse_precedence(CloxCompiler * const compiler, CloxPrecedence precedence);
 
 static const CloxParseRule * get_rule(CloxTokenType type);
 
-static void number();
-static void binary();
-static void expression();
-static void grouping();
-static void unary();
-
-static const CloxParseRule rules[] = {
-    { grouping, NULL,    PRECEDENCE_CALL },       // TOKEN_LEFT_PAREN
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_RIGHT_PAREN
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_LEFT_BRACE
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_RIGHT_BRACE
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_COMMA
-    { NULL,     NULL,    PRECEDENCE_CALL },       // TOKEN_DOT
-    { unary,    binary,  PRECEDENCE_TERM },       // TOKEN_MINUS
-    { NULL,     binary,  PRECEDENCE_TERM },       // TOKEN_PLUS
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_SEMICOLON
-    { NULL,     binary,  PRECEDENCE_FACTOR },     // TOKEN_SLASH
-    { NULL,     binary,  PRECEDENCE_FACTOR },     // TOKEN_STAR
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_BANG
-    { NULL,     NULL,    PRECEDENCE_EQUALITY },   // TOKEN_BANG_EQUAL
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_EQUAL
-    { NULL,     NULL,    PRECEDENCE_EQUALITY },   // TOKEN_EQUAL_EQUAL
-    { NULL,     NULL,    PRECEDENCE_COMPARISON }, // TOKEN_GREATER
-    { NULL,     NULL,    PRECEDENCE_COMPARISON }, // TOKEN_GREATER_EQUAL
-    { NULL,     NULL,    PRECEDENCE_COMPARISON }, // TOKEN_LESS
-    { NULL,     NULL,    PRECEDENCE_COMPARISON }, // TOKEN_LESS_EQUAL
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_IDENTIFIER
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_STRING
-    { number,   NULL,    PRECEDENCE_NONE },       // TOKEN_NUMBER
-    { NULL,     NULL,    PRECEDENCE_AND },        // TOKEN_AND
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_CLASS
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_ELSE
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_FALSE
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_FUN
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_FOR
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_IF
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_NIL
-    { NULL,     NULL,    PRECEDENCE_OR },         // TOKEN_OR
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_PRINT
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_RETURN
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_SUPER
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_THIS
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_TRUE
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_VAR
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_WHILE
-    { NULL,     NULL,    PRECEDENCE_NONE },       // TOKEN_ERROR
-    { NULL,     NULL,    PRECEDENCE_NONE }        // TOKEN_EOF
+static void number(CloxCompiler * const compiler);
+static void literal(CloxCompiler * const compiler);
+static void input(CloxCompiler * const compiler);
+static void binary(CloxCompiler * const compiler);
+static void expression(CloxCompiler * const compiler);
+static void grouping(CloxCompiler * const compiler);
+static void unary(CloxCompiler * const compiler);
+
+// Tokens left out have no parse functions and PRECEDENCE_NONE.
+static const CloxParseRule rules[TOKEN_EOF + 1] = {
+    [TOKEN_LEFT_PAREN]    = { grouping, NULL,    PRECEDENCE_CALL },
+    [TOKEN_DOT]           = { NULL,     NULL,    PRECEDENCE_CALL },
+    [TOKEN_MINUS]         = { unary,    binary,  PRECEDENCE_TERM },
+    [TOKEN_PLUS]          = { NULL,     binary,  PRECEDENCE_TERM },
+    [TOKEN_SLASH]         = { NULL,     binary,  PRECEDENCE_FACTOR },
+    [TOKEN_STAR]          = { NULL,     binary,  PRECEDENCE_FACTOR },
+    [TOKEN_BANG_EQUAL]    = { NULL,     NULL,    PRECEDENCE_EQUALITY },
+    [TOKEN_EQUAL_EQUAL]   = { NULL,     NULL,    PRECEDENCE_EQUALITY },
+    [TOKEN_GREATER]       = { NULL,     NULL,    PRECEDENCE_COMPARISON },
+    [TOKEN_GREATER_EQUAL] = { NULL,     NULL,    PRECEDENCE_COMPARISON },
+    [TOKEN_LESS]          = { NULL,     NULL,    PRECEDENCE_COMPARISON },
+    [TOKEN_LESS_EQUAL]    = { NULL,     NULL,    PRECEDENCE_COMPARISON },
+    [TOKEN_IDENTIFIER]    = { input,    NULL,    PRECEDENCE_NONE },
+    [TOKEN_NUMBER]        = { number,   NULL,    PRECEDENCE_NONE },
+    [TOKEN_AND]           = { NULL,     NULL,    PRECEDENCE_AND },
+    [TOKEN_FALSE]         = { literal,  NULL,    PRECEDENCE_NONE },
+    [TOKEN_NIL]           = { literal,  NULL,    PRECEDENCE_NONE },
+    [TOKEN_OR]            = { NULL,     NULL,    PRECEDENCE_OR },
+    [TOKEN_TRUE]          = { literal,  NULL,    PRECEDENCE_NONE }
 };
 
-static CloxChunk *compiling_chunk;
-
-static CloxChunk * current_chunk() {
-    return compiling_chunk;
+static CloxChunk * current_chunk(CloxCompiler * const compiler) {
+    return compiler->chunk;
 }
 
-static void error_at(const CloxToken * const token, const char * const message) {
-    if (parser.panic_mode) {
+static void error_at(CloxCompiler * const compiler, const CloxToken * const token, const char * const message) {
+    if (compiler->parser.panic_mode) {
         return;
     }
 
-    parser.panic_mode = true;
+    compiler->parser.panic_mode = true;
     fprintf(stderr, "[line %d] Error", token->line);
 
     if (token->type == TOKEN_EOF) {
@@ -138,132 +147,243 @@ static void error_at(const CloxToken * const token, const char * const message)
     }
 
     fprintf(stderr, ": %s\n", message);
-    parser.had_error = true;
+    compiler->parser.had_error = true;
 }
 
-static void error(const char * const message) {
-    error_at(&parser.previous, message);
+static void error(CloxCompiler * const compiler, const char * const message) {
+    error_at(compiler, &compiler->parser.previous, message);
 }
 
-static void error_at_current(const char * const message) {
-    error_at(&parser.current, message);
+static void error_at_current(CloxCompiler * const compiler, const char * const message) {
+    error_at(compiler, &compiler->parser.current, message);
 }
 
-static void advance() {
-    parser.previous = parser.current;
+static void advance(CloxCompiler * const compiler) {
+    compiler->parser.previous = compiler->parser.current;
 
     for (;;) {
-        parser.current = clox_scanner_scan_token();
-        if (parser.current.type != TOKEN_ERROR)
+        compiler->parser.current = clox_scanner_scan_token(&compiler->scanner);
+        if (compiler->parser.current.type != TOKEN_ERROR)
             break;
 
-        error_at_current(parser.current.start);
+        error_at_current(compiler, compiler->parser.current.start);
     }
 }
 
-static void consume(CloxTokenType type, const char * const message) {
-    if (parser.current.type == type) {
-        advance();
+static void consume(CloxCompiler * const compiler, CloxTokenType type, const char * const message) {
+    if (compiler->parser.current.type == type) {
+        advance(compiler);
         return;
     }
 
-    error_at_current(message);
+    error_at_current(compiler, message);
 }
 
-static uint16_t make_constant(CloxValue value) {
-    int constantIndex = clox_chunk_add_constant(current_chunk(), value);
+static uint16_t make_constant(CloxCompiler * const compiler, CloxValue value) {
+    int constantIndex = clox_chunk_add_constant(current_chunk(compiler), value);
 
     if (constantIndex > MAX_NUM_CONSTANTS) {
-        error("Too many constants in one chunk.");
+        error(compiler, "Too many constants in one chunk.");
         return 0;
     }
 
     return (uint16_t)constantIndex;
 }
 
-static void emit_byte(uint8_t byte) {
-    clox_chunk_write(current_chunk(), byte, parser.previous.line);
+static void emit_byte(CloxCompiler * const compiler, uint8_t byte) {
+    clox_chunk_write(current_chunk(compiler), byte, compiler->parser.previous.line);
 }
 
-static void emit_bytes(size_t len, const uint8_t * const bytes) {
+static void emit_bytes(CloxCompiler * const compiler, size_t len, const uint8_t * const bytes) {
     for (size_t i = 0; i < len; i++) {
-        emit_byte(bytes[i]);
+        emit_byte(compiler, bytes[i]);
     }
 }
 
-static void emit_return() {
-    emit_byte(OP_RETURN);
+static void emit_return(CloxCompiler * const compiler) {
+    emit_byte(compiler, OP_RETURN);
 }
 
-static void emit_constant(CloxValue value) {
-    uint16_t constantIndex = make_constant(value);
+static void emit_constant(CloxCompiler * const compiler, double value) {
+    compiler->last_constant.start = current_chunk(compiler)->count;
+    compiler->last_constant.constants_before = current_chunk(compiler)->constants.count;
+    compiler->last_constant.value = value;
+
+    uint16_t constantIndex = make_constant(compiler, CLOX_NUMBER_VAL(value));
     uint8_t lower = (uint8_t)(constantIndex & 0xFF);
     if (constantIndex > UINT8_MAX) {
         uint8_t upper = (uint8_t)(constantIndex >> 8);
-        emit_bytes(3, BYTES(OP_CONSTANT_LONG, upper, lower));
+        emit_bytes(compiler, 3, BYTES(OP_CONSTANT_LONG, upper, lower));
     } else {
-        emit_bytes(2, BYTES(OP_CONSTANT, lower));
+        emit_bytes(compiler, 2, BYTES(OP_CONSTANT, lower));
     }
+
+    compiler->last_constant.end = current_chunk(compiler)->count;
+}
+
+// Whether the code emitted last is a constant load, which is then copied to
+// `operand`. The copy is made either way, so callers never see it unset.
+static bool last_constant_operand(CloxCompiler * const compiler, CloxConstantOperand * const operand) {
+    *operand = compiler->last_constant;
+    return compiler->last_constant.end == current_chunk(compiler)->count;
 }
 
-static void end_compiler() {
-    emit_return();
+// Replaces the code from the first folded operand onwards with a single load of
+// the folded value. Any constants added to the pool since then were new values
+// only referenced by that code, so they are dropped as well.
+static void fold_constant(CloxCompiler * const compiler, const CloxConstantOperand * const first, double value) {
+    clox_chunk_truncate(current_chunk(compiler), first->start);
+    clox_chunk_truncate_constants(current_chunk(compiler), first->constants_before);
+    emit_constant(compiler, value);
+}
+
+static void end_compiler(CloxCompiler * const compiler) {
+    emit_return(compiler);
+
+    // Constants are only deduplicated while compiling, the VM never looks
+    // values up by content.
+    clox_chunk_free_constant_index(current_chunk(compiler));
 
 #ifdef CLOX_DEBUG_PRINT_CODE
-    if (!parser.had_error) {
-        clox_chunk_disassemble(current_chunk(), "code");
+    if (!compiler->parser.had_error) {
+        clox_chunk_disassemble(current_chunk(compiler), "code");
     }
 #endif
 }
 
-static void parse_precedence(CloxPrecedence precedence) {
-    advance();
-    CloxParseFunc prefixFunc = get_rule(parser.previous.type)->prefix;
+static void parse_precedence(CloxCompiler * const compiler, CloxPrecedence precedence) {
+    advance(compiler);
+    CloxParseFunc prefixFunc = get_rule(compiler->parser.previous.type)->prefix;
 
     if (prefixFunc == NULL) {
-        error("Expected expression.");
+        error(compiler, "Expected expression.");
         return;
     }
 
-    prefixFunc();
+    // Every level of nesting recurses through here.
+    if (compiler->depth == CLOX_COMPILER_MAX_DEPTH) {
+        error(compiler, "Expression nests too deeply.");
+        return;
+    }
+
+    compiler->depth++;
+    prefixFunc(compiler);
+
+    while (precedence <= get_rule(compiler->parser.current.type)->precedence) {
+        advance(compiler);
+        CloxParseFunc infixFunc = get_rule(compiler->parser.previous.type)->infix;
 
-    while (precedence <= get_rule(parser.current.type)->precedence) {
-        advance();
-        CloxParseFunc infixFunc = get_rule(parser.previous.type)->infix;
-        infixFunc();
+        // Some operators already have a precedence but aren't implemented yet.
+        if (infixFunc == NULL) {
+            error(compiler, "Unsupported operator.");
+            break;
+        }
+
+        infixFunc(compiler);
     }
+
+    compiler->depth--;
 }
 
 static const CloxParseRule * get_rule(CloxTokenType type) {
     return &rules[type];
 }
 
-static void number() {
-    double value = strtod(parser.previous.start, NULL);
-    emit_constant(value);
+static void number(CloxCompiler * const compiler) {
+    const CloxToken * const token = &compiler->parser.previous;
+    double value = clox_number_parse(token->start, token->length);
+    emit_constant(compiler, value);
 }
 
-static void binary() {
-    CloxTokenType opType = parser.previous.type;
+static void literal(CloxCompiler * const compiler) {
+    switch (compiler->parser.previous.type) {
+        case TOKEN_FALSE:
+            emit_byte(compiler, OP_FALSE);
+            break;
+
+        case TOKEN_NIL:
+            emit_byte(compiler, OP_NIL);
+            break;
+
+        case TOKEN_TRUE:
+            emit_byte(compiler, OP_TRUE);
+            break;
+
+        default:
+            return;
+    }
+}
+
+// A name is only ever one of the inputs the chunk was declared with.
+static void input(CloxCompiler * const compiler) {
+    const CloxToken * const token = &compiler->parser.previous;
+
+    for (int slot = 0; slot < compiler->input_count; slot++) {
+        const char * const name = compiler->inputs[slot];
+
+        if (strncmp(name, token->start, (size_t)token->length) == 0 && name[token->length] == '\0') {
+            emit_bytes(compiler, 2, BYTES(OP_INPUT, (uint8_t)slot));
+            return;
+        }
+    }
+
+    error(compiler, compiler->input_count == 0 ? "Expected expression." : "Unknown input.");
+}
+
+static void binary(CloxCompiler * const compiler) {
+    CloxTokenType opType = compiler->parser.previous.type;
+
+    CloxConstantOperand left;
+    bool leftConstant = last_constant_operand(compiler, &left);
 
     const CloxParseRule * const rule = get_rule(opType);
-    parse_precedence((CloxPrecedence)(rule->precedence + 1));
+    int rightStart = current_chunk(compiler)->count;
+    parse_precedence(compiler, (CloxPrecedence)(rule->precedence + 1));
+
+    CloxConstantOperand right;
+    bool rightConstant = last_constant_operand(compiler, &right) && right.start == rightStart;
+
+    if (leftConstant && rightConstant && left.end == rightStart) {
+        // Evaluated with the same double arithmetic the VM uses, so the folded
+        // result is bit-identical to what running the code would produce,
+        // including infinities from division by zero, NaN and -0.0.
+        switch (opType) {
+            case TOKEN_PLUS:
+                fold_constant(compiler, &left, left.value + right.value);
+                return;
+
+            case TOKEN_MINUS:
+                fold_constant(compiler, &left, left.value - right.value);
+                return;
+
+            case TOKEN_STAR:
+                fold_constant(compiler, &left, left.value * right.value);
+                return;
+
+            case TOKEN_SLASH:
+                fold_constant(compiler, &left, left.value / right.value);
+                return;
+
+            default:
+                break;
+        }
+    }
 
     switch (opType) {
         case TOKEN_PLUS:
-            emit_byte(OP_ADD);
+            emit_byte(compiler, OP_ADD);
             break;
 
         case TOKEN_MINUS:
-            emit_byte(OP_SUBTRACT);
+            emit_byte(compiler, OP_SUBTRACT);
             break;
 
         case TOKEN_STAR:
-            emit_byte(OP_MULTIPLY);
+            emit_byte(compiler, OP_MULTIPLY);
             break;
 
         case TOKEN_SLASH:
-            emit_byte(OP_DIVIDE);
+            emit_byte(compiler, OP_DIVIDE);
             break;
 
         default:
@@ -271,23 +391,36 @@ static void binary() {
     }
 }
 
-static void expression() {
-    parse_precedence(PRECEDENCE_ASSIGNMENT);
+static void expression(CloxCompiler * const compiler) {
+    parse_precedence(compiler, PRECEDENCE_ASSIGNMENT);
 }
 
-static void grouping() {
-    expression();
-    consume(TOKEN_RIGHT_PAREN, "Expected ')' after expression.");
+static void grouping(CloxCompiler * const compiler) {
+    expression(compiler);
+    consume(compiler, TOKEN_RIGHT_PAREN, "Expected ')' after expression.");
 }
 
-static void unary() {
-    CloxTokenType opType = parser.previous.type;
+static void unary(CloxCompiler * const compiler) {
+    CloxTokenType opType = compiler->parser.previous.type;
+    int operandStart = current_chunk(compiler)->count;
 
-    parse_precedence(PRECEDENCE_UNARY);
+    parse_precedence(compiler, PRECEDENCE_UNARY);
+
+    CloxConstantOperand operand;
+    if (last_constant_operand(compiler, &operand) && operand.start == operandStart) {
+        switch (opType) {
+            case TOKEN_MINUS:
+                fold_constant(compiler, &operand, -operand.value);
+                return;
+
+            default:
+                break;
+        }
+    }
 
     switch (opType) {
         case TOKEN_MINUS:
-            emit_byte(OP_NEGATE);
+            emit_byte(compiler, OP_NEGATE);
             break;
 
         default:
@@ -295,17 +428,63 @@ static void unary() {
     }
 }
 
+// Compiles whatever the scanner has been set up to read, then releases it.
+static bool compile(CloxCompiler * const compiler, CloxChunk * const chunk) {
+    compiler->chunk = chunk;
+    compiler->last_constant = (CloxConstantOperand){ -1, -1, 0, 0.0 };
+    compiler->depth = 0;
+    chunk->input_count = compiler->input_count;
+
+    compiler->parser.had_error = false;
+    compiler->parser.panic_mode = false;
+
+    advance(compiler);
+    expression(compiler);
+    consume(compiler, TOKEN_EOF, "Expected end of expression.");
+    end_compiler(compiler);
+    clox_scanner_free(&compiler->scanner);
+
+    if (compiler->parser.had_error) {
+        return false;
+    }
+
+    clox_optimize_chunk(chunk);
+    chunk->max_stack = clox_chunk_compute_max_stack(chunk);
+
+#ifdef CLOX_DEBUG_PRINT_CODE
+    clox_chunk_disassemble(chunk, "optimized");
+#endif
+
+    return true;
+}
+
 bool clox_compiler_compile(const char * const source, CloxChunk *chunk) {
-    clox_scanner_init(source);
+    return clox_compiler_compile_inputs(source, NULL, 0, chunk);
+}
 
-    compiling_chunk = chunk;
+// Compiles source read from `fd` as it arrives, so the whole program never
+// has to be in memory at once.
+bool clox_compiler_compile_stream(int fd, CloxChunk *chunk) {
+    CloxCompiler compiler;
+    compiler.inputs = NULL;
+    compiler.input_count = 0;
+    clox_scanner_init_stream(&compiler.scanner, fd);
+    return compile(&compiler, chunk);
+}
 
-    parser.had_error = false;
-    parser.panic_mode = false;
+// Compiles an expression over `count` named inputs, up to
+// CLOX_CHUNK_MAX_INPUTS. Each name in the source is read from the input slot
+// of the same index when the chunk runs, see clox_vm_evaluate() and
+// clox_vm_run_lanes().
+bool clox_compiler_compile_inputs(const char * const source, const char * const * const names, int count, CloxChunk *chunk) {
+    if (count < 0 || count > CLOX_CHUNK_MAX_INPUTS) {
+        fprintf(stderr, "Too many inputs: %d, the limit is %d.\n", count, CLOX_CHUNK_MAX_INPUTS);
+        return false;
+    }
 
-    advance();
-    expression();
-    consume(TOKEN_EOF, "Expected end of expression.");
-    end_compiler();
-    return !parser.had_error;
+    CloxCompiler compiler;
+    compiler.inputs = names;
+    compiler.input_count = count;
+    clox_scanner_init(&compiler.scanner, source);
+    return compile(&compiler, chunk);
 }
@@ -5,21 +5,26 @@
 #include "value.h"
 
 static int instruction_simple(const char * const name, int offset) {
-    printf("%-16s\n", name);
+    printf("%-20s\n", name);
     return offset + 1;
 }
 
 static int instruction_constant(const char * const name, const CloxChunk * const chunk, int offset) {
     uint8_t constantIndex = chunk->code[offset + 1];
-    printf("%-16s 0x%02x '", name, constantIndex);
+    printf("%-20s 0x%02x '", name, constantIndex);
     clox_value_print(chunk->constants.values[constantIndex]);
     printf("'\n");
     return offset + 2;
 }
 
+static int instruction_input(const char * const name, const CloxChunk * const chunk, int offset) {
+    printf("%-20s 0x%02x\n", name, chunk->code[offset + 1]);
+    return offset + 2;
+}
+
 static int instruction_constant_long(const char * const name, const CloxChunk * const chunk, int offset) {
     uint16_t constantIndex = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
-    printf("%-16s 0x%04x '", name, constantIndex);
+    printf("%-20s 0x%04x '", name, constantIndex);
     clox_value_print(chunk->constants.values[constantIndex]);
     printf("'\n");
     return offset + 3;
@@ -28,18 +33,28 @@ static int instruction_constant_long(const char * const name, const CloxChunk *
 void clox_chunk_disassemble(const CloxChunk * const chunk, const char * const name) {
     printf("== %s ==\n", name);
 
-    for (int i = 0; i < chunk->count;) {
+    int instructions = 0;
+
+    for (int i = 0; i < chunk->count; instructions++) {
         i = clox_chunk_disassemble_instruction(chunk, i);
     }
+
+    printf(
+        "== %d instructions, %d bytes, %d constants ==\n",
+        instructions,
+        chunk->count,
+        chunk->constants.count);
 }
 
 int clox_chunk_disassemble_instruction(const CloxChunk * const chunk, int offset) {
     printf("0x%04x ", offset);
 
-    if (offset > 0 && chunk->line_numbers[offset] == chunk->line_numbers[offset - 1]) {
+    int line = clox_chunk_get_line(chunk, offset);
+
+    if (offset > 0 && line == clox_chunk_get_line(chunk, offset - 1)) {
         printf("   | ");
     } else {
-        printf("%4d ", chunk->line_numbers[offset]);
+        printf("%4d ", line);
     }
 
     uint8_t instruction = chunk->code[offset];
@@ -50,10 +65,18 @@ int clox_chunk_disassemble_instruction(const CloxChunk * const chunk, int offset
     switch (instruction) {
         CHUNK_CASE(OP_CONSTANT, instruction_constant);
         CHUNK_CASE(OP_CONSTANT_LONG, instruction_constant_long);
+        SIMPLE_CASE(OP_NIL);
+        SIMPLE_CASE(OP_TRUE);
+        SIMPLE_CASE(OP_FALSE);
+        CHUNK_CASE(OP_INPUT, instruction_input);
         SIMPLE_CASE(OP_ADD);
         SIMPLE_CASE(OP_SUBTRACT);
         SIMPLE_CASE(OP_MULTIPLY);
         SIMPLE_CASE(OP_DIVIDE);
+        CHUNK_CASE(OP_ADD_CONSTANT, instruction_constant);
+        CHUNK_CASE(OP_SUBTRACT_CONSTANT, instruction_constant);
+        CHUNK_CASE(OP_MULTIPLY_CONSTANT, instruction_constant);
+        CHUNK_CASE(OP_DIVIDE_CONSTANT, instruction_constant);
         SIMPLE_CASE(OP_NEGATE);
         SIMPLE_CASE(OP_RETURN);
 
@@ -65,3 +88,30 @@ int clox_chunk_disassemble_instruction(const CloxChunk * const chunk, int offset
 #undef CHUNK_CASE
 #undef SIMPLE_CASE
 }
+
+const char * clox_opcode_name(uint8_t opcode) {
+#define NAME_CASE(op) case op: return #op
+
+    switch (opcode) {
+        NAME_CASE(OP_CONSTANT);
+        NAME_CASE(OP_CONSTANT_LONG);
+        NAME_CASE(OP_NIL);
+        NAME_CASE(OP_TRUE);
+        NAME_CASE(OP_FALSE);
+        NAME_CASE(OP_INPUT);
+        NAME_CASE(OP_ADD);
+        NAME_CASE(OP_SUBTRACT);
+        NAME_CASE(OP_MULTIPLY);
+        NAME_CASE(OP_DIVIDE);
+        NAME_CASE(OP_ADD_CONSTANT);
+        NAME_CASE(OP_SUBTRACT_CONSTANT);
+        NAME_CASE(OP_MULTIPLY_CONSTANT);
+        NAME_CASE(OP_DIVIDE_CONSTANT);
+        NAME_CASE(OP_NEGATE);
+        NAME_CASE(OP_RETURN);
+    }
+
+#undef NAME_CASE
+
+    return "(unknown)";
+}
@@ -0,0 +1,260 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "emit_c.h"
+#include "config.h"
+
+// The chunk becomes one C function over an explicit array standing in for
+// the stack. Every instruction turns into a statement on fixed elements of
+// it, since the stack depth at each instruction is known, and the constant
+// pool into a static const double array. An optimizing C compiler then keeps
+// the whole stack in registers and drops the array altogether.
+//
+// The arithmetic is plain C double arithmetic, as in run(). It is only bit
+// for bit the same as clox's if the C compiler doesn't contract a * b + c into
+// a fused multiply-add, which ISO C modes don't; GNU modes need
+// -ffp-contract=off. As with --jit, which NaN comes out of an operation on
+// two NaNs may differ.
+
+static const char * const binary_operators[] = {
+    [OP_ADD] = "+", [OP_SUBTRACT] = "-", [OP_MULTIPLY] = "*", [OP_DIVIDE] = "/",
+    [OP_ADD_CONSTANT] = "+", [OP_SUBTRACT_CONSTANT] = "-",
+    [OP_MULTIPLY_CONSTANT] = "*", [OP_DIVIDE_CONSTANT] = "/"
+};
+
+// Hexadecimal floating point literals are exact; infinities and NaNs come
+// from math.h.
+static void write_number(FILE * const out, double number) {
+    if (isnan(number)) {
+        fputs(signbit(number) ? "-NAN" : "NAN", out);
+    } else if (isinf(number)) {
+        fputs(number < 0 ? "-INFINITY" : "INFINITY", out);
+    } else {
+        fprintf(out, "%a", number);
+    }
+}
+
+static void write_header(FILE * const out, const CloxChunk * const chunk, const char * const * const names) {
+    fprintf(out, "// Generated by clox %s with --emit-c.\n", CLOX_VERSION_STR);
+    fprintf(out, "//\n");
+    fprintf(out, "// double CLOX_EXPRESSION(const double *inputs) computes the expression,\n");
+    fprintf(out, "// reading %d inputs. Build with -ffp-contract=off, the default in ISO C\n", chunk->input_count);
+    fprintf(out, "// modes, for results bit for bit the same as clox's, and with\n");
+    fprintf(out, "// -DCLOX_EXPRESSION_MAIN for a program taking the inputs as arguments.\n");
+    fprintf(out, "// That program prints the result with printf's %%.17g, which reads back\n");
+    fprintf(out, "// as the same double but isn't always the shortest form clox prints.\n");
+
+    if (names != NULL && chunk->input_count > 0) {
+        fprintf(out, "//\n");
+
+        for (int slot = 0; slot < chunk->input_count; slot++) {
+            fprintf(out, "// inputs[%d] is %s\n", slot, names[slot]);
+        }
+    }
+
+    fprintf(out, "\n#include <math.h>\n\n");
+    fprintf(out, "#ifndef CLOX_EXPRESSION\n#define CLOX_EXPRESSION %s\n#endif\n\n", CLOX_EMIT_C_FUNCTION);
+    fprintf(out, "double CLOX_EXPRESSION(const double *inputs);\n\n");
+}
+
+static void write_constants(FILE * const out, const CloxChunk * const chunk) {
+    if (chunk->constants.count == 0) {
+        return;
+    }
+
+    fprintf(out, "static const double constants[%d] = {\n", chunk->constants.count);
+
+    for (int i = 0; i < chunk->constants.count; i++) {
+        fputs("    ", out);
+        write_number(out, CLOX_AS_NUMBER(chunk->constants.values[i]));
+        fputs(i + 1 < chunk->constants.count ? ",\n" : "\n", out);
+    }
+
+    fprintf(out, "};\n\n");
+}
+
+// Whether any instruction reads an input. Folding can remove every read of
+// an input the chunk declares.
+static bool reads_inputs(const CloxChunk * const chunk) {
+    for (int offset = 0; offset < chunk->count;) {
+        switch (chunk->code[offset]) {
+            case OP_INPUT:
+                return true;
+
+            case OP_CONSTANT_LONG:
+                offset += 3;
+                break;
+
+            case OP_CONSTANT:
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT:
+                offset += 2;
+                break;
+
+            default:
+                offset++;
+                break;
+        }
+    }
+
+    return false;
+}
+
+// One statement per instruction, with a comment wherever the source line
+// changes. Returns false on code that doesn't keep within the chunk's
+// max_stack.
+static bool write_function(FILE * const out, const CloxChunk * const chunk) {
+    fprintf(out, "double CLOX_EXPRESSION(const double *inputs) {\n");
+    fprintf(out, "    double stack[%d];\n", chunk->max_stack > 0 ? chunk->max_stack : 1);
+
+    if (!reads_inputs(chunk)) {
+        fprintf(out, "    (void)inputs;\n");
+    }
+
+    int depth = 0;
+    int line = -1;
+
+    for (int offset = 0; offset < chunk->count;) {
+        const uint8_t instruction = chunk->code[offset];
+        const uint8_t * const operand = chunk->code + offset + 1;
+
+        const int instructionLine = clox_chunk_get_line(chunk, offset);
+
+        if (instructionLine != line) {
+            line = instructionLine;
+            fprintf(out, "\n    // line %d\n", line);
+        }
+
+        switch (instruction) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG:
+            case OP_INPUT:
+                if (depth >= chunk->max_stack) {
+                    return false;
+                }
+
+                if (instruction == OP_INPUT) {
+                    fprintf(out, "    stack[%d] = inputs[%d];\n", depth, operand[0]);
+                } else if (instruction == OP_CONSTANT) {
+                    fprintf(out, "    stack[%d] = constants[%d];\n", depth, operand[0]);
+                } else {
+                    fprintf(out, "    stack[%d] = constants[%d];\n", depth, (operand[0] << 8) | operand[1]);
+                }
+
+                depth++;
+                offset += instruction == OP_CONSTANT_LONG ? 3 : 2;
+                break;
+
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+                if (depth < 2) {
+                    return false;
+                }
+
+                depth--;
+                fprintf(out, "    stack[%d] = stack[%d] %s stack[%d];\n",
+                    depth - 1, depth - 1, binary_operators[instruction], depth);
+                offset++;
+                break;
+
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT:
+                if (depth < 1) {
+                    return false;
+                }
+
+                fprintf(out, "    stack[%d] = stack[%d] %s constants[%d];\n",
+                    depth - 1, depth - 1, binary_operators[instruction], operand[0]);
+                offset += 2;
+                break;
+
+            case OP_NEGATE:
+                if (depth < 1) {
+                    return false;
+                }
+
+                fprintf(out, "    stack[%d] = -stack[%d];\n", depth - 1, depth - 1);
+                offset++;
+                break;
+
+            case OP_RETURN:
+                if (depth < 1) {
+                    return false;
+                }
+
+                fprintf(out, "    return stack[%d];\n}\n", depth - 1);
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    return false;
+}
+
+static void write_main(FILE * const out, const CloxChunk * const chunk) {
+    const int count = chunk->input_count;
+
+    fprintf(out, "\n#ifdef CLOX_EXPRESSION_MAIN\n");
+    fprintf(out, "#include <stdio.h>\n#include <stdlib.h>\n\n");
+    fprintf(out, "// Reads the inputs from the command line and prints the result with %%.17g.\n");
+    fprintf(out, "int main(int argc, char *argv[]) {\n");
+    fprintf(out, "    double inputs[%d] = { 0 };\n\n", count > 0 ? count : 1);
+    fprintf(out, "    if (argc != %d) {\n", count + 1);
+    fprintf(out, "        fprintf(stderr, \"Usage: %%s%s\\n\", argv[0]);\n", count > 0 ? " <one number per input>" : "");
+    fprintf(out, "        return 2;\n    }\n\n");
+
+    if (count > 0) {
+        fprintf(out, "    for (int i = 0; i < %d; i++) {\n", count);
+        fprintf(out, "        inputs[i] = strtod(argv[i + 1], NULL);\n    }\n\n");
+    }
+
+    fprintf(out, "    printf(\"%%.17g\\n\", CLOX_EXPRESSION(inputs));\n");
+    fprintf(out, "    return 0;\n}\n#endif\n");
+}
+
+bool clox_emit_c_write(const CloxChunk * const chunk, const char * const * const names, const char * const path) {
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open \"%s\" for writing.\n", path);
+        return false;
+    }
+
+    write_header(file, chunk, names);
+    write_constants(file, chunk);
+    bool emitted = write_function(file, chunk);
+
+    if (emitted) {
+        write_main(file, chunk);
+    }
+
+    bool written = !ferror(file);
+
+    if (fclose(file) != 0) {
+        written = false;
+    }
+
+    // Nothing is left behind that a build could pick up half-written.
+    if (!emitted) {
+        fprintf(stderr, "Failed to write C to \"%s\": the code is malformed.\n", path);
+        remove(path);
+        return false;
+    }
+
+    if (!written) {
+        fprintf(stderr, "Failed to write C to \"%s\".\n", path);
+        remove(path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Writes the scanner's lookup tables.
+
+    gen_lexer_tables.py KEYWORDS TOKENS_HEADER TABLES_HEADER
+
+KEYWORDS lists the reserved words (see keywords.txt). TOKENS_HEADER gets
+their token types for the CloxTokenType enum. TABLES_HEADER gets the
+character class table, the single-character token table, and a perfect hash
+over the keywords that picks a keyword from an identifier's first and last
+characters and its length.
+"""
+
+import sys
+
+# Characters that make up a token on their own. The ones that may also be
+# followed by '=' are marked; the token with the '=' comes right after them
+# in CloxTokenType.
+SINGLE_TOKENS = {
+    "(": "TOKEN_LEFT_PAREN",
+    ")": "TOKEN_RIGHT_PAREN",
+    "{": "TOKEN_LEFT_BRACE",
+    "}": "TOKEN_RIGHT_BRACE",
+    ";": "TOKEN_SEMICOLON",
+    ",": "TOKEN_COMMA",
+    ".": "TOKEN_DOT",
+    "-": "TOKEN_MINUS",
+    "+": "TOKEN_PLUS",
+    "/": "TOKEN_SLASH",
+    "*": "TOKEN_STAR",
+    "!": "TOKEN_BANG",
+    "=": "TOKEN_EQUAL",
+    "<": "TOKEN_LESS",
+    ">": "TOKEN_GREATER",
+}
+TAKES_EQUAL = "!=<>"
+
+ALPHA = 1
+DIGIT = 2
+BLANK = 4
+EQUAL_SUFFIX = 8
+
+
+def read_keywords(path):
+    with open(path) as source:
+        words = [line.strip() for line in source]
+
+    words = [word for word in words if word and not word.startswith("#")]
+
+    if len(set(words)) != len(words):
+        sys.exit("%s: duplicate keyword" % path)
+
+    for word in words:
+        if not all(c.isascii() and (c.isalnum() or c == "_") for c in word) or word[0].isdigit():
+            sys.exit("%s: \"%s\" isn't an identifier" % (path, word))
+
+    return words
+
+
+def hash_keyword(word, first, last, mask):
+    return (ord(word[0]) * first + ord(word[-1]) * last + len(word)) & mask
+
+
+def find_hash(words):
+    # The smallest power-of-two table, then the smallest multipliers, for
+    # which no two keywords land in the same slot.
+    size = 1
+
+    while size < len(words):
+        size *= 2
+
+    while size <= 4096:
+        for first in range(1, 256):
+            for last in range(0, 256):
+                slots = {hash_keyword(word, first, last, size - 1) for word in words}
+
+                if len(slots) == len(words):
+                    return size, first, last
+
+        size *= 2
+
+    sys.exit("no perfect hash found for the keyword list")
+
+
+def char_class(c):
+    bits = 0
+
+    if c.isascii() and (c.isalpha() or c == "_"):
+        bits |= ALPHA
+    if c.isascii() and c.isdigit():
+        bits |= DIGIT
+    if c in " \t\r\n":
+        bits |= BLANK
+    if c in TAKES_EQUAL:
+        bits |= EQUAL_SUFFIX
+
+    return bits
+
+
+def c_string(word):
+    return '"%s"' % word
+
+
+def write_tokens(words, path):
+    with open(path, "w") as out:
+        out.write("// Generated by gen_lexer_tables.py from keywords.txt.\n\n")
+        out.write("#pragma once\n\n")
+        out.write("#define CLOX_KEYWORD_TOKENS \\\n")
+        out.write(" \\\n".join("    TOKEN_%s," % word.upper() for word in words))
+        out.write("\n")
+
+
+def write_tables(words, path):
+    size, first, last = find_hash(words)
+    slots = [None] * size
+
+    for word in words:
+        slots[hash_keyword(word, first, last, size - 1)] = word
+
+    lengths = [len(word) for word in words]
+
+    if min(lengths) < 1:
+        sys.exit("keywords can't be empty")
+
+    with open(path, "w") as out:
+        out.write("// Generated by gen_lexer_tables.py from keywords.txt.\n\n")
+        out.write("#pragma once\n\n")
+        out.write("#include <stdint.h>\n\n")
+        out.write('#include "scanner.h"\n\n')
+
+        out.write("#define CLOX_CHAR_ALPHA %d\n" % ALPHA)
+        out.write("#define CLOX_CHAR_DIGIT %d\n" % DIGIT)
+        out.write("#define CLOX_CHAR_BLANK %d\n" % BLANK)
+        out.write("#define CLOX_CHAR_EQUAL_SUFFIX %d\n\n" % EQUAL_SUFFIX)
+
+        out.write("static const uint8_t clox_char_class[256] = {\n")
+        for row in range(0, 256, 16):
+            out.write("    %s,\n" % ", ".join(str(char_class(chr(c))) for c in range(row, row + 16)))
+        out.write("};\n\n")
+
+        out.write("// TOKEN_ERROR for characters that don't start a token by themselves.\n")
+        out.write("static const uint8_t clox_char_token[256] = {\n")
+        for row in range(0, 256, 4):
+            out.write("    %s,\n" % ", ".join(SINGLE_TOKENS.get(chr(c), "TOKEN_ERROR") for c in range(row, row + 4)))
+        out.write("};\n\n")
+
+        width = max(lengths)
+        out.write("typedef struct CloxKeyword CloxKeyword;\n")
+        out.write("struct CloxKeyword {\n    char text[%d];\n    int length;\n    CloxTokenType type;\n};\n\n" % width)
+        out.write("static const CloxKeyword clox_keywords[%d] = {\n" % size)
+        for word in slots:
+            if word is None:
+                out.write("    { \"\", 0, TOKEN_IDENTIFIER },\n")
+            else:
+                out.write("    { %s, %d, TOKEN_%s },\n" % (c_string(word), len(word), word.upper()))
+        out.write("};\n\n")
+
+        out.write("// The keyword `start` spells, if any. Every keyword has its own slot,\n")
+        out.write("// so only one has to be compared against, and nothing in the lookup\n")
+        out.write("// branches on the identifier, since which identifiers are keywords is\n")
+        out.write("// hard to predict. Lengths that no keyword has fail on the length\n")
+        out.write("// alone, and no character past the end of the identifier is read.\n")
+        out.write("static inline CloxTokenType clox_keyword_type(const char * const start, int length) {\n")
+        out.write("    const CloxKeyword * const keyword = &clox_keywords[\n")
+        out.write("        ((uint8_t)start[0] * %du + (uint8_t)start[length - 1] * %du + (unsigned)length) & %du];\n"
+                  % (first, last, size - 1))
+        out.write("    unsigned difference = (unsigned)(keyword->length ^ length);\n\n")
+        out.write("    // `inside` is 1 for the identifier's characters and 0 past them, where\n")
+        out.write("    // the first character is read again and then ignored.\n")
+        out.write("    for (int i = 0; i < %d; i++) {\n" % width)
+        out.write("        unsigned inside = (unsigned)(i - length) >> 31;\n")
+        out.write("        unsigned c = (uint8_t)start[i * (int)inside];\n")
+        out.write("        difference |= (c ^ (uint8_t)keyword->text[i]) * inside;\n")
+        out.write("    }\n\n")
+        out.write("    int found = difference == 0;\n")
+        out.write("    return (CloxTokenType)(TOKEN_IDENTIFIER + found * ((int)keyword->type - TOKEN_IDENTIFIER));\n}\n")
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.stderr.write(__doc__)
+        return 2
+
+    words = read_keywords(sys.argv[1])
+    write_tokens(words, sys.argv[2])
+    write_tables(words, sys.argv[3])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
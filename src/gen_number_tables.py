@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""Writes the power-of-five tables used by clox_number_format().
+
+    gen_number_tables.py OUTPUT
+
+These are the tables of the Ryu algorithm (Ulf Adams, "Ryu: fast
+float-to-string conversion", PLDI 2018): 5^i and 2^k / 5^i, each scaled to
+a fixed number of significant bits and split into two 64-bit halves.
+"""
+
+import sys
+
+POW5_BITCOUNT = 125
+POW5_INV_BITCOUNT = 125
+POW5_TABLE_SIZE = 326
+POW5_INV_TABLE_SIZE = 342
+
+
+def split(value):
+    mask = (1 << 64) - 1
+    return "{ UINT64_C(%d), UINT64_C(%d) }" % (value & mask, value >> 64)
+
+
+def pow5_split(i):
+    # 5^i with its top bit at POW5_BITCOUNT - 1, truncated.
+    power = 5 ** i
+    shift = power.bit_length() - POW5_BITCOUNT
+    return power >> shift if shift >= 0 else power << -shift
+
+
+def pow5_inv_split(i):
+    # 2^(bitlength(5^i) - 1 + POW5_INV_BITCOUNT) / 5^i, rounded up.
+    power = 5 ** i
+    return (1 << (power.bit_length() - 1 + POW5_INV_BITCOUNT)) // power + 1
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write(__doc__)
+        return 2
+
+    with open(sys.argv[1], "w") as out:
+        out.write("// Generated by gen_number_tables.py.\n\n")
+        out.write("#pragma once\n\n")
+        out.write("#include <stdint.h>\n\n")
+        out.write("#define CLOX_POW5_BITCOUNT %d\n" % POW5_BITCOUNT)
+        out.write("#define CLOX_POW5_INV_BITCOUNT %d\n\n" % POW5_INV_BITCOUNT)
+
+        out.write("static const uint64_t clox_pow5_split[%d][2] = {\n" % POW5_TABLE_SIZE)
+        out.write(",\n".join("    " + split(pow5_split(i)) for i in range(POW5_TABLE_SIZE)))
+        out.write("\n};\n\n")
+
+        out.write("static const uint64_t clox_pow5_inv_split[%d][2] = {\n" % POW5_INV_TABLE_SIZE)
+        out.write(",\n".join("    " + split(pow5_inv_split(i)) for i in range(POW5_INV_TABLE_SIZE)))
+        out.write("\n};\n")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,8 +1,17 @@
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "io.h"
 #include "errors.h"
+#include "memory.h"
 
 char * clox_read_line() {
     size_t buffer_size = 1024;
@@ -38,34 +47,189 @@ char * clox_read_line() {
     return buffer;
 }
 
-char * clox_read_file(const char * const path) {
-    FILE *file = fopen(path, "rb");
+// Reads a stream of unknown length, such as a pipe, growing the buffer as it
+// goes since its size can't be asked for up front. The buffer is trimmed to
+// the text and its terminator at the end, which is what it is freed as.
+static char * read_stream(FILE * const file, const char * const path, size_t * const length) {
+    size_t capacity = 0;
+    size_t count = 0;
+    char *buffer = NULL;
+
+    do {
+        size_t oldCapacity = capacity;
+        capacity = capacity == 0 ? 4096 : capacity * 2;
+        buffer = (char*)CLOX_REALLOCATE(CLOX_ALLOC_IO, buffer, oldCapacity, capacity);
+
+        if (buffer == NULL) {
+            fprintf(stderr, "Failed to allocate memory for reading \"%s\".\n", path);
+            exit(CLOX_EXIT_OOM_ERROR);
+        }
+
+        count += fread(buffer + count, sizeof(char), capacity - count - 1, file);
+    } while (count == capacity - 1);
+
+    if (ferror(file)) {
+        fprintf(stderr, "Failed to read all bytes from \"%s\".\n", path);
+        exit(CLOX_EXIT_FILE_ERROR);
+    }
+
+    buffer = (char*)CLOX_REALLOCATE(CLOX_ALLOC_IO, buffer, capacity, count + 1);
+    buffer[count] = '\0';
+    *length = count;
+    return buffer;
+}
+
+// Maps a regular file followed by at least one zero byte. The file can't be
+// mapped past its end, so an anonymous zero-filled region one byte longer is
+// reserved first and the file is mapped over the start of it: the terminator
+// comes either from the zeroed tail of the file's last page or, when the file
+// fills its last page exactly, from the anonymous page after it.
+static bool map_file(CloxSource * const source, const int fd, const size_t length) {
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t file_pages = (length + page - 1) / page * page;
+    const size_t total = (length + 1 + page - 1) / page * page;
+
+    void *region = mmap(NULL, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED) {
+        return false;
+    }
+
+    if (mmap(region, file_pages, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(region, total);
+        return false;
+    }
+
+    posix_madvise(region, file_pages, POSIX_MADV_SEQUENTIAL);
+
+    source->text = (char*)region;
+    source->length = length;
+    source->mapped = total;
+    return true;
+}
+
+void clox_source_open(CloxSource * const source, const char * const path) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        fprintf(stderr, "Failed to open \"%s\" for reading.\n", path);
+        exit(CLOX_EXIT_FILE_ERROR);
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0
+            && map_file(source, fd, (size_t)info.st_size)) {
+        close(fd);
+        return;
+    }
+
+    // Pipes, character devices and empty files can't be mapped (or have no
+    // size worth trusting), so they are read into a heap buffer instead.
+    FILE *file = fdopen(fd, "rb");
 
     if (file == NULL) {
         fprintf(stderr, "Failed to open \"%s\" for reading.\n", path);
         exit(CLOX_EXIT_FILE_ERROR);
     }
 
-    fseek(file, 0L, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file);
+    source->text = read_stream(file, path, &source->length);
+    source->mapped = 0;
+    fclose(file);
+}
+
+void clox_source_close(CloxSource * const source) {
+    if (source->mapped > 0) {
+        munmap(source->text, source->mapped);
+    } else {
+        CLOX_REALLOCATE(CLOX_ALLOC_IO, source->text, source->length + 1, 0);
+    }
+
+    source->text = NULL;
+    source->length = 0;
+    source->mapped = 0;
+}
 
-    char *buffer = (char*)malloc(fileSize + 1);
+#define LINE_READER_BLOCK (1024 * 1024)
 
-    if (buffer == NULL) {
-        fprintf(stderr, "Failed to allocate memory for reading \"%s\".\n", path);
+void clox_line_reader_init(CloxLineReader * const reader, int fd) {
+    reader->fd = fd;
+    reader->eof = false;
+    reader->buffer = (char*)CLOX_REALLOCATE(CLOX_ALLOC_IO, NULL, 0, LINE_READER_BLOCK);
+    reader->capacity = LINE_READER_BLOCK;
+    reader->start = 0;
+    reader->count = 0;
+
+    if (reader->buffer == NULL) {
+        fprintf(stderr, "OUT OF MEMORY in clox_line_reader_init\n");
         exit(CLOX_EXIT_OOM_ERROR);
     }
+}
 
-    size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
+// Moves the unfinished line at the end of the buffer to its front and reads
+// another block after it, doubling the buffer if that line already fills it.
+static void fill_line_buffer(CloxLineReader * const reader) {
+    size_t pending = reader->count - reader->start;
+    memmove(reader->buffer, reader->buffer + reader->start, pending);
+    reader->start = 0;
+    reader->count = pending;
+
+    // One byte is always kept free for terminating a last line with no '\n'.
+    if (pending + 1 >= reader->capacity) {
+        reader->buffer = (char*)CLOX_REALLOCATE(CLOX_ALLOC_IO, reader->buffer, reader->capacity, reader->capacity * 2);
+        reader->capacity *= 2;
+
+        if (reader->buffer == NULL) {
+            fprintf(stderr, "OUT OF MEMORY in clox_line_reader_next\n");
+            exit(CLOX_EXIT_OOM_ERROR);
+        }
+    }
 
-    if (bytesRead < fileSize) {
-        fprintf(stderr, "Failed to read all bytes from \"%s\".\n", path);
+    ssize_t bytesRead;
+
+    do {
+        bytesRead = read(reader->fd, reader->buffer + pending, reader->capacity - pending - 1);
+    } while (bytesRead == -1 && errno == EINTR);
+
+    if (bytesRead == -1) {
+        fprintf(stderr, "Failed to read input: %s.\n", strerror(errno));
         exit(CLOX_EXIT_FILE_ERROR);
     }
 
-    buffer[bytesRead] = '\0';
+    reader->eof = bytesRead == 0;
+    reader->count += (size_t)bytesRead;
+}
 
-    fclose(file);
-    return buffer;
+// Returns the next line without its '\n', or NULL once the input is used up.
+char * clox_line_reader_next(CloxLineReader * const reader) {
+    for (;;) {
+        char * const line = reader->buffer + reader->start;
+        char * const newline = memchr(line, '\n', reader->count - reader->start);
+
+        if (newline != NULL) {
+            *newline = '\0';
+            reader->start = (size_t)(newline - reader->buffer) + 1;
+            return line;
+        }
+
+        if (reader->eof) {
+            if (reader->start == reader->count) {
+                return NULL;
+            }
+
+            reader->buffer[reader->count] = '\0';
+            reader->start = reader->count;
+            return line;
+        }
+
+        fill_line_buffer(reader);
+    }
+}
+
+void clox_line_reader_free(CloxLineReader * const reader) {
+    CLOX_REALLOCATE(CLOX_ALLOC_IO, reader->buffer, reader->capacity, 0);
+    reader->buffer = NULL;
+    reader->capacity = 0;
+    reader->start = 0;
+    reader->count = 0;
 }
@@ -0,0 +1,435 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#define CLOX_JIT_X86
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// A chunk is straight-line code over a stack whose depth is known at every
+// instruction, so each stack slot can be given a fixed home: the first
+// REGISTER_SLOTS live in xmm0 upwards, the rest in the VM's stack, which the
+// code is handed in rdi. Every instruction then becomes a short template of
+// SSE2 instructions on those homes, with constants read from the chunk's pool
+// in rsi and inputs from rdx. Only chunks that deal in nothing but numbers are
+// translated, so none of the interpreter's type checks are needed.
+//
+// The arithmetic is the same IEEE double arithmetic run() does, so results
+// are bit for bit the interpreter's, except that when both operands of an
+// operation are NaNs it's the left one that comes through here, where the
+// interpreter leaves that to the C compiler.
+
+typedef double (*CloxJitFunction)(CloxValue *stack, const CloxValue *constants, const double *inputs);
+
+// Sits at the start of the code's mapping.
+struct CloxJitCode {
+    size_t size;
+    CloxJitFunction function;
+};
+
+#ifdef CLOX_JIT_X86
+
+// After the CloxJitCode come the values the code reads relative to its own
+// address, then the code itself. xorpd needs its operand 16-byte aligned.
+#define SIGN_MASK_OFFSET 16
+#define CANONICAL_NAN_OFFSET 32
+#define CODE_OFFSET 48
+
+// More than any one instruction's template takes.
+#define INSTRUCTION_MAX 48
+
+#define REGISTER_SLOTS 14
+#define SCRATCH 14
+
+#define RDX 2
+#define RSI 6
+#define RDI 7
+
+#define PREFIX_SD 0xf2
+#define PREFIX_PD 0x66
+
+#define MOVSD_LOAD 0x10
+#define MOVSD_STORE 0x11
+#define ADDSD 0x58
+#define MULSD 0x59
+#define SUBSD 0x5c
+#define DIVSD 0x5e
+#define MOVAPD 0x28
+#define XORPD 0x57
+#define UCOMISD 0x2e
+
+_Static_assert(sizeof(CloxJitCode) <= SIGN_MASK_OFFSET, "the code header fits before the constants");
+_Static_assert(sizeof(CloxJitFunction) == sizeof(void *), "code addresses convert to functions");
+
+typedef struct CloxJitEmitter CloxJitEmitter;
+struct CloxJitEmitter {
+    uint8_t *base;
+    size_t count;
+};
+
+static void emit_byte(CloxJitEmitter * const emitter, uint8_t byte) {
+    emitter->base[emitter->count++] = byte;
+}
+
+static void emit_int32(CloxJitEmitter * const emitter, int32_t value) {
+    memcpy(emitter->base + emitter->count, &value, sizeof(value));
+    emitter->count += sizeof(value);
+}
+
+// The prefix, REX byte if either register is xmm8 or up, and opcode of an
+// SSE instruction with `reg` in ModRM.reg and `rm` in ModRM.rm.
+static void emit_opcode(CloxJitEmitter * const emitter, uint8_t prefix, uint8_t opcode, int reg, int rm) {
+    emit_byte(emitter, prefix);
+
+    if (reg >= 8 || rm >= 8) {
+        emit_byte(emitter, (uint8_t)(0x40 | (reg >= 8) << 2 | (rm >= 8)));
+    }
+
+    emit_byte(emitter, 0x0f);
+    emit_byte(emitter, opcode);
+}
+
+// op xmm`reg`, xmm`rm`
+static void emit_register(CloxJitEmitter * const emitter, uint8_t prefix, uint8_t opcode, int reg, int rm) {
+    emit_opcode(emitter, prefix, opcode, reg, rm);
+    emit_byte(emitter, (uint8_t)(0xc0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+// op xmm`reg`, [`base` + `displacement`], for a base register below r8 other
+// than rsp and rbp.
+static void emit_memory(CloxJitEmitter * const emitter, uint8_t prefix, uint8_t opcode, int reg, int base, int32_t displacement) {
+    emit_opcode(emitter, prefix, opcode, reg, base);
+
+    if (displacement >= INT8_MIN && displacement <= INT8_MAX) {
+        emit_byte(emitter, (uint8_t)(0x40 | (reg & 7) << 3 | base));
+        emit_byte(emitter, (uint8_t)(int8_t)displacement);
+    } else {
+        emit_byte(emitter, (uint8_t)(0x80 | (reg & 7) << 3 | base));
+        emit_int32(emitter, displacement);
+    }
+}
+
+// op xmm`reg`, [rip to the value at `offset` in the mapping]
+static void emit_literal(CloxJitEmitter * const emitter, uint8_t prefix, uint8_t opcode, int reg, size_t offset) {
+    emit_opcode(emitter, prefix, opcode, reg, 0);
+    emit_byte(emitter, (uint8_t)(0x05 | (reg & 7) << 3));
+    emit_int32(emitter, (int32_t)((ptrdiff_t)offset - (ptrdiff_t)(emitter->count + sizeof(int32_t))));
+}
+
+static int32_t slot_offset(int slot) {
+    return (int32_t)(slot * (int)sizeof(CloxValue));
+}
+
+// The register an instruction computes `slot` into.
+static int slot_register(int slot) {
+    return slot < REGISTER_SLOTS ? slot : SCRATCH;
+}
+
+// The register holding `slot`, loading it from the stack first if it lives
+// there.
+static int load_slot(CloxJitEmitter * const emitter, int slot) {
+    if (slot < REGISTER_SLOTS) {
+        return slot;
+    }
+
+    emit_memory(emitter, PREFIX_SD, MOVSD_LOAD, SCRATCH, RDI, slot_offset(slot));
+    return SCRATCH;
+}
+
+static void store_slot(CloxJitEmitter * const emitter, int slot, int reg) {
+    if (slot >= REGISTER_SLOTS) {
+        emit_memory(emitter, PREFIX_SD, MOVSD_STORE, reg, RDI, slot_offset(slot));
+    }
+}
+
+static void emit_constant(CloxJitEmitter * const emitter, int slot, int index) {
+    const int reg = slot_register(slot);
+    emit_memory(emitter, PREFIX_SD, MOVSD_LOAD, reg, RSI, (int32_t)(index * (int)sizeof(CloxValue)));
+    store_slot(emitter, slot, reg);
+}
+
+// Inputs are read the way clox_value_canonical() reads them: a NaN, which is
+// the only value that compares unordered with itself, is replaced.
+static void emit_input(CloxJitEmitter * const emitter, int slot, int index) {
+    const int reg = slot_register(slot);
+    emit_memory(emitter, PREFIX_SD, MOVSD_LOAD, reg, RDX, (int32_t)(index * (int)sizeof(double)));
+    emit_register(emitter, PREFIX_PD, UCOMISD, reg, reg);
+
+    // jnp over the replacement.
+    emit_byte(emitter, 0x7b);
+    const size_t jump = emitter->count;
+    emit_byte(emitter, 0);
+    emit_literal(emitter, PREFIX_SD, MOVSD_LOAD, reg, CANONICAL_NAN_OFFSET);
+    emitter->base[jump] = (uint8_t)(emitter->count - jump - 1);
+
+    store_slot(emitter, slot, reg);
+}
+
+// The two slots on top of the stack, `slot` and the one above it, combined
+// into `slot`.
+static void emit_binary(CloxJitEmitter * const emitter, uint8_t opcode, int slot) {
+    const int left = load_slot(emitter, slot);
+
+    if (slot + 1 < REGISTER_SLOTS) {
+        emit_register(emitter, PREFIX_SD, opcode, left, slot + 1);
+    } else {
+        emit_memory(emitter, PREFIX_SD, opcode, left, RDI, slot_offset(slot + 1));
+    }
+
+    store_slot(emitter, slot, left);
+}
+
+static void emit_binary_constant(CloxJitEmitter * const emitter, uint8_t opcode, int slot, int index) {
+    const int left = load_slot(emitter, slot);
+    emit_memory(emitter, PREFIX_SD, opcode, left, RSI, (int32_t)(index * (int)sizeof(CloxValue)));
+    store_slot(emitter, slot, left);
+}
+
+static void emit_negate(CloxJitEmitter * const emitter, int slot) {
+    const int reg = load_slot(emitter, slot);
+    emit_literal(emitter, PREFIX_PD, XORPD, reg, SIGN_MASK_OFFSET);
+    store_slot(emitter, slot, reg);
+}
+
+// The result goes back in xmm0.
+static void emit_return(CloxJitEmitter * const emitter, int slot) {
+    if (slot >= REGISTER_SLOTS) {
+        emit_memory(emitter, PREFIX_SD, MOVSD_LOAD, 0, RDI, slot_offset(slot));
+    } else if (slot > 0) {
+        emit_register(emitter, PREFIX_PD, MOVAPD, 0, slot);
+    }
+
+    emit_byte(emitter, 0xc3);
+}
+
+static bool is_number_constant(const CloxChunk * const chunk, int index) {
+    return index < chunk->constants.count && CLOX_IS_NUMBER(chunk->constants.values[index]);
+}
+
+static size_t operand_size(uint8_t instruction) {
+    switch (instruction) {
+        case OP_CONSTANT_LONG:
+            return 2;
+
+        case OP_CONSTANT:
+        case OP_INPUT:
+        case OP_ADD_CONSTANT:
+        case OP_SUBTRACT_CONSTANT:
+        case OP_MULTIPLY_CONSTANT:
+        case OP_DIVIDE_CONSTANT:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// Emits the chunk's code up to its OP_RETURN. Returns false on anything that
+// isn't a number or arithmetic, and on code that doesn't keep to the chunk's
+// max_stack, whose slots are all the stack the code can count on.
+static bool emit_chunk(CloxJitEmitter * const emitter, const CloxChunk * const chunk) {
+    int depth = 0;
+
+    for (int offset = 0; offset < chunk->count;) {
+        const uint8_t instruction = chunk->code[offset++];
+        const uint8_t * const operand = chunk->code + offset;
+
+        if ((size_t)(chunk->count - offset) < operand_size(instruction)) {
+            return false;
+        }
+
+        offset += (int)operand_size(instruction);
+
+        switch (instruction) {
+            case OP_CONSTANT:
+            case OP_CONSTANT_LONG: {
+                int index = instruction == OP_CONSTANT ? operand[0] : (operand[0] << 8) | operand[1];
+
+                if (depth >= chunk->max_stack || !is_number_constant(chunk, index)) {
+                    return false;
+                }
+
+                emit_constant(emitter, depth++, index);
+                break;
+            }
+
+            case OP_INPUT:
+                if (depth >= chunk->max_stack || operand[0] >= chunk->input_count) {
+                    return false;
+                }
+
+                emit_input(emitter, depth++, operand[0]);
+                break;
+
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE: {
+                static const uint8_t opcodes[] = {
+                    [OP_ADD] = ADDSD, [OP_SUBTRACT] = SUBSD, [OP_MULTIPLY] = MULSD, [OP_DIVIDE] = DIVSD
+                };
+
+                if (depth < 2) {
+                    return false;
+                }
+
+                depth--;
+                emit_binary(emitter, opcodes[instruction], depth - 1);
+                break;
+            }
+
+            case OP_ADD_CONSTANT:
+            case OP_SUBTRACT_CONSTANT:
+            case OP_MULTIPLY_CONSTANT:
+            case OP_DIVIDE_CONSTANT: {
+                static const uint8_t opcodes[] = {
+                    [OP_ADD_CONSTANT] = ADDSD, [OP_SUBTRACT_CONSTANT] = SUBSD,
+                    [OP_MULTIPLY_CONSTANT] = MULSD, [OP_DIVIDE_CONSTANT] = DIVSD
+                };
+
+                if (depth < 1 || !is_number_constant(chunk, operand[0])) {
+                    return false;
+                }
+
+                emit_binary_constant(emitter, opcodes[instruction], depth - 1, operand[0]);
+                break;
+            }
+
+            case OP_NEGATE:
+                if (depth < 1) {
+                    return false;
+                }
+
+                emit_negate(emitter, depth - 1);
+                break;
+
+            case OP_RETURN:
+                if (depth < 1) {
+                    return false;
+                }
+
+                emit_return(emitter, depth - 1);
+                return true;
+
+            default:
+                return false;
+        }
+    }
+
+    return false;
+}
+
+bool clox_jit_available(void) {
+    return true;
+}
+
+// A writable mapping of at least `*capacity` bytes. That is `spare`'s if it's
+// big enough, in which case `*capacity` is set to its size, and otherwise a
+// new one, with `spare` unmapped. Returns NULL if there's none to be had.
+static void * writable_mapping(CloxJitCode * const spare, size_t * const capacity) {
+    if (spare != NULL) {
+        const size_t size = spare->size;
+
+        if (size >= *capacity && mprotect(spare, size, PROT_READ | PROT_WRITE) == 0) {
+            *capacity = size;
+            return spare;
+        }
+
+        munmap(spare, size);
+    }
+
+    void * const mapping = mmap(NULL, *capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mapping != MAP_FAILED ? mapping : NULL;
+}
+
+CloxJitCode * clox_jit_compile(const CloxChunk * const chunk, CloxJitCode * const spare) {
+    // Stack slots are addressed with 32-bit displacements.
+    if (chunk->count < CLOX_JIT_MIN_CODE || chunk->max_stack > INT32_MAX / (int)sizeof(CloxValue)) {
+        clox_jit_free(spare);
+        return NULL;
+    }
+
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t capacity = (CODE_OFFSET + INSTRUCTION_MAX * (size_t)chunk->count + page - 1) / page * page;
+    void * const mapping = writable_mapping(spare, &capacity);
+
+    if (mapping == NULL) {
+        return NULL;
+    }
+
+    CloxJitEmitter emitter = { (uint8_t *)mapping, CODE_OFFSET };
+
+    if (!emit_chunk(&emitter, chunk)) {
+        munmap(mapping, capacity);
+        return NULL;
+    }
+
+    const uint64_t sign = UINT64_C(1) << 63;
+    const uint64_t nan = CLOX_CANONICAL_NAN;
+    memcpy(emitter.base + SIGN_MASK_OFFSET, &sign, sizeof(sign));
+    memcpy(emitter.base + SIGN_MASK_OFFSET + sizeof(sign), &sign, sizeof(sign));
+    memcpy(emitter.base + CANONICAL_NAN_OFFSET, &nan, sizeof(nan));
+
+    // Pages the code didn't get to are given back.
+    const size_t size = (emitter.count + page - 1) / page * page;
+
+    if (size < capacity) {
+        munmap(emitter.base + size, capacity - size);
+    }
+
+    CloxJitCode * const code = (CloxJitCode *)mapping;
+    void * const entry = emitter.base + CODE_OFFSET;
+    code->size = size;
+    memcpy(&code->function, &entry, sizeof(code->function));
+
+    if (mprotect(mapping, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    return code;
+}
+
+double clox_jit_run(const CloxJitCode * const code, CloxValue * const stack, const CloxValue * const constants, const double * const inputs) {
+    return code->function(stack, constants, inputs);
+}
+
+void clox_jit_free(CloxJitCode * const code) {
+    if (code != NULL) {
+        munmap(code, code->size);
+    }
+}
+
+#else
+
+bool clox_jit_available(void) {
+    return false;
+}
+
+CloxJitCode * clox_jit_compile(const CloxChunk * const chunk, CloxJitCode * const spare) {
+    (void)chunk;
+    (void)spare;
+    return NULL;
+}
+
+double clox_jit_run(const CloxJitCode * const code, CloxValue * const stack, const CloxValue * const constants, const double * const inputs) {
+    // clox_jit_compile() never returns any code to run.
+    (void)code;
+    (void)stack;
+    (void)constants;
+    (void)inputs;
+    return 0.0;
+}
+
+void clox_jit_free(CloxJitCode * const code) {
+    (void)code;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lane_kernels.h"
+#include "value.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CLOX_LANE_X86
+#include <immintrin.h>
+#endif
+
+static inline double canonical_nan(void) {
+    return clox_value_to_number(CLOX_CANONICAL_NAN);
+}
+
+static inline double canonical_value(double value) {
+    return clox_value_to_number(clox_value_canonical(value));
+}
+
+static void scalar_add(double *result, const double *a, const double *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] + b[i];
+    }
+}
+
+static void scalar_subtract(double *result, const double *a, const double *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] - b[i];
+    }
+}
+
+static void scalar_multiply(double *result, const double *a, const double *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] * b[i];
+    }
+}
+
+static void scalar_divide(double *result, const double *a, const double *b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] / b[i];
+    }
+}
+
+static void scalar_add_constant(double *result, const double *a, double b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] + b;
+    }
+}
+
+static void scalar_subtract_constant(double *result, const double *a, double b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] - b;
+    }
+}
+
+static void scalar_multiply_constant(double *result, const double *a, double b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] * b;
+    }
+}
+
+static void scalar_divide_constant(double *result, const double *a, double b, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = a[i] / b;
+    }
+}
+
+static void scalar_negate(double *result, const double *a, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = -a[i];
+    }
+}
+
+static void scalar_canonical(double *result, const double *a, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = canonical_value(a[i]);
+    }
+}
+
+static void scalar_fill(double *result, double value, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        result[i] = value;
+    }
+}
+
+#ifdef CLOX_LANE_X86
+
+#define KERNEL(name) sse2_##name
+#define LANE_WIDTH 2
+#define LANE_VECTOR __m128d
+#define LANE_FUNCTION
+#define LANE_LOAD _mm_loadu_pd
+#define LANE_STORE _mm_storeu_pd
+#define LANE_SET1 _mm_set1_pd
+#define LANE_ADD _mm_add_pd
+#define LANE_SUB _mm_sub_pd
+#define LANE_MUL _mm_mul_pd
+#define LANE_DIV _mm_div_pd
+#define LANE_XOR _mm_xor_pd
+#define LANE_AND _mm_and_pd
+#define LANE_ANDNOT _mm_andnot_pd
+#define LANE_OR _mm_or_pd
+#define LANE_UNORDERED _mm_cmpunord_pd
+#include "lane_kernels_simd.h"
+#undef KERNEL
+#undef LANE_WIDTH
+#undef LANE_VECTOR
+#undef LANE_FUNCTION
+#undef LANE_LOAD
+#undef LANE_STORE
+#undef LANE_SET1
+#undef LANE_ADD
+#undef LANE_SUB
+#undef LANE_MUL
+#undef LANE_DIV
+#undef LANE_XOR
+#undef LANE_AND
+#undef LANE_ANDNOT
+#undef LANE_OR
+#undef LANE_UNORDERED
+
+#define KERNEL(name) avx2_##name
+#define LANE_WIDTH 4
+#define LANE_VECTOR __m256d
+#define LANE_FUNCTION __attribute__((target("avx2")))
+#define LANE_LOAD _mm256_loadu_pd
+#define LANE_STORE _mm256_storeu_pd
+#define LANE_SET1 _mm256_set1_pd
+#define LANE_ADD _mm256_add_pd
+#define LANE_SUB _mm256_sub_pd
+#define LANE_MUL _mm256_mul_pd
+#define LANE_DIV _mm256_div_pd
+#define LANE_XOR _mm256_xor_pd
+#define LANE_AND _mm256_and_pd
+#define LANE_ANDNOT _mm256_andnot_pd
+#define LANE_OR _mm256_or_pd
+#define LANE_UNORDERED(a, b) _mm256_cmp_pd(a, b, _CMP_UNORD_Q)
+#include "lane_kernels_simd.h"
+
+#endif
+
+#define LANE_KERNELS(prefix) { \
+        #prefix, \
+        prefix##_add, prefix##_subtract, prefix##_multiply, prefix##_divide, \
+        prefix##_add_constant, prefix##_subtract_constant, prefix##_multiply_constant, prefix##_divide_constant, \
+        prefix##_negate, prefix##_canonical, prefix##_fill \
+    }
+
+static const CloxLaneKernels kernels[CLOX_LANE_LEVEL_COUNT] = {
+    [CLOX_LANE_SCALAR] = LANE_KERNELS(scalar),
+#ifdef CLOX_LANE_X86
+    [CLOX_LANE_SSE2] = LANE_KERNELS(sse2),
+    [CLOX_LANE_AVX2] = LANE_KERNELS(avx2),
+#endif
+};
+
+// Read by every VM, so atomic: the first thread to need kernels picks them,
+// and a clox_lane_kernels_select() made before then wins.
+static const CloxLaneKernels * _Atomic selected = NULL;
+
+static bool is_supported(CloxLaneLevel level) {
+    if (kernels[level].name == NULL) {
+        return false;
+    }
+
+#ifdef CLOX_LANE_X86
+    if (level == CLOX_LANE_AVX2) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+
+    return true;
+}
+
+const CloxLaneKernels * clox_lane_kernels(void) {
+    const CloxLaneKernels *current = atomic_load_explicit(&selected, memory_order_acquire);
+
+    if (current == NULL) {
+        CloxLaneLevel level = CLOX_LANE_LEVEL_COUNT - 1;
+
+        while (!is_supported(level)) {
+            level--;
+        }
+
+        // Losing the race leaves `current` holding the other thread's pick.
+        const CloxLaneKernels *widest = &kernels[level];
+
+        if (atomic_compare_exchange_strong_explicit(
+                &selected, &current, widest, memory_order_acq_rel, memory_order_acquire)) {
+            current = widest;
+        }
+    }
+
+    return current;
+}
+
+bool clox_lane_kernels_select(CloxLaneLevel level) {
+    if (level >= CLOX_LANE_LEVEL_COUNT || !is_supported(level)) {
+        return false;
+    }
+
+    atomic_store_explicit(&selected, &kernels[level], memory_order_release);
+    return true;
+}
@@ -0,0 +1,103 @@
+// The body of the SIMD lane kernels, included by lane_kernels.c once per
+// instruction set with these defined for it:
+//
+//   KERNEL(name)   the name to give a function for this instruction set
+//   LANE_WIDTH     doubles per vector
+//   LANE_VECTOR    the vector type
+//   LANE_FUNCTION  attributes for each function
+//   LANE_LOAD, LANE_STORE, LANE_SET1, LANE_ADD, LANE_SUB, LANE_MUL, LANE_DIV,
+//   LANE_XOR, LANE_AND, LANE_ANDNOT, LANE_OR, LANE_UNORDERED
+//
+// Loads and stores are unaligned, since input and result columns come from
+// the caller. Two vectors are done per iteration to keep both arithmetic
+// ports busy, and lanes left over at the end go through the scalar code.
+
+#define LANE_STEP (2 * LANE_WIDTH)
+
+#define LANE_BINARY(name, vector_op, op) \
+    LANE_FUNCTION static void KERNEL(name)(double *result, const double *a, const double *b, size_t count) { \
+        size_t i = 0; \
+        for (; i + LANE_STEP <= count; i += LANE_STEP) { \
+            LANE_VECTOR low = vector_op(LANE_LOAD(a + i), LANE_LOAD(b + i)); \
+            LANE_VECTOR high = vector_op(LANE_LOAD(a + i + LANE_WIDTH), LANE_LOAD(b + i + LANE_WIDTH)); \
+            LANE_STORE(result + i, low); \
+            LANE_STORE(result + i + LANE_WIDTH, high); \
+        } \
+        for (; i < count; i++) { \
+            result[i] = a[i] op b[i]; \
+        } \
+    }
+
+#define LANE_BINARY_CONSTANT(name, vector_op, op) \
+    LANE_FUNCTION static void KERNEL(name)(double *result, const double *a, double b, size_t count) { \
+        const LANE_VECTOR constant = LANE_SET1(b); \
+        size_t i = 0; \
+        for (; i + LANE_STEP <= count; i += LANE_STEP) { \
+            LANE_VECTOR low = vector_op(LANE_LOAD(a + i), constant); \
+            LANE_VECTOR high = vector_op(LANE_LOAD(a + i + LANE_WIDTH), constant); \
+            LANE_STORE(result + i, low); \
+            LANE_STORE(result + i + LANE_WIDTH, high); \
+        } \
+        for (; i < count; i++) { \
+            result[i] = a[i] op b; \
+        } \
+    }
+
+LANE_BINARY(add, LANE_ADD, +)
+LANE_BINARY(subtract, LANE_SUB, -)
+LANE_BINARY(multiply, LANE_MUL, *)
+LANE_BINARY(divide, LANE_DIV, /)
+LANE_BINARY_CONSTANT(add_constant, LANE_ADD, +)
+LANE_BINARY_CONSTANT(subtract_constant, LANE_SUB, -)
+LANE_BINARY_CONSTANT(multiply_constant, LANE_MUL, *)
+LANE_BINARY_CONSTANT(divide_constant, LANE_DIV, /)
+
+#undef LANE_BINARY_CONSTANT
+#undef LANE_BINARY
+
+// Negation only flips the sign bit, NaNs included, as scalar negation does.
+LANE_FUNCTION static void KERNEL(negate)(double *result, const double *a, size_t count) {
+    const LANE_VECTOR sign = LANE_SET1(-0.0);
+    size_t i = 0;
+
+    for (; i + LANE_STEP <= count; i += LANE_STEP) {
+        LANE_VECTOR low = LANE_XOR(LANE_LOAD(a + i), sign);
+        LANE_VECTOR high = LANE_XOR(LANE_LOAD(a + i + LANE_WIDTH), sign);
+        LANE_STORE(result + i, low);
+        LANE_STORE(result + i + LANE_WIDTH, high);
+    }
+
+    for (; i < count; i++) {
+        result[i] = -a[i];
+    }
+}
+
+LANE_FUNCTION static void KERNEL(canonical)(double *result, const double *a, size_t count) {
+    const LANE_VECTOR nan = LANE_SET1(canonical_nan());
+    size_t i = 0;
+
+    for (; i + LANE_WIDTH <= count; i += LANE_WIDTH) {
+        LANE_VECTOR value = LANE_LOAD(a + i);
+        LANE_VECTOR is_nan = LANE_UNORDERED(value, value);
+        LANE_STORE(result + i, LANE_OR(LANE_AND(is_nan, nan), LANE_ANDNOT(is_nan, value)));
+    }
+
+    for (; i < count; i++) {
+        result[i] = canonical_value(a[i]);
+    }
+}
+
+LANE_FUNCTION static void KERNEL(fill)(double *result, double value, size_t count) {
+    const LANE_VECTOR vector = LANE_SET1(value);
+    size_t i = 0;
+
+    for (; i + LANE_WIDTH <= count; i += LANE_WIDTH) {
+        LANE_STORE(result + i, vector);
+    }
+
+    for (; i < count; i++) {
+        result[i] = value;
+    }
+}
+
+#undef LANE_STEP
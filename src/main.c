@@ -1,12 +1,20 @@
+#include <ctype.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "io.h"
+#include "memory.h"
 #include "options.h"
+#include "profile.h"
 #include "config.h"
+#include "bytecode.h"
 #include "chunk.h"
+#include "compiler.h"
 #include "debug.h"
+#include "emit_c.h"
 #include "vm.h"
 #include "errors.h"
 
@@ -20,20 +28,144 @@ static void print_version(const char * const name) {
         __STDC_VERSION__);
 }
 
-static void repl() {
+static size_t parse_size(const char * const name, const char * const value) {
+    char *end;
+    unsigned long long size = strtoull(value, &end, 10);
+
+    if (*value == '\0' || *end != '\0' || size == 0 || size > SIZE_MAX) {
+        fprintf(stderr, "Invalid value \"%s\" for %s.\n", value, name);
+        exit(CLOX_EXIT_USAGE_ERROR);
+    }
+
+    return (size_t)size;
+}
+
+// The names given to --inputs, which compiled expressions read as inputs.
+typedef struct CloxInputNames CloxInputNames;
+struct CloxInputNames {
+    const char *names[CLOX_CHUNK_MAX_INPUTS];
+    int count;
+};
+
+static bool is_identifier(const char *name) {
+    if (!(isalpha((unsigned char)*name) || *name == '_')) {
+        return false;
+    }
+
+    while (isalnum((unsigned char)*name) || *name == '_') {
+        name++;
+    }
+
+    return *name == '\0';
+}
+
+// Splits the comma-separated `list` in place.
+static CloxInputNames parse_inputs(char * const list) {
+    CloxInputNames inputs;
+    inputs.count = 0;
+    char *name = list;
+
+    for (;;) {
+        char * const comma = strchr(name, ',');
+
+        if (comma != NULL) {
+            *comma = '\0';
+        }
+
+        bool duplicate = false;
+
+        for (int i = 0; i < inputs.count; i++) {
+            duplicate = duplicate || strcmp(inputs.names[i], name) == 0;
+        }
+
+        if (!is_identifier(name) || duplicate || inputs.count == CLOX_CHUNK_MAX_INPUTS) {
+            fprintf(stderr, "Invalid input name \"%s\" for --inputs.\n", name);
+            exit(CLOX_EXIT_USAGE_ERROR);
+        }
+
+        inputs.names[inputs.count++] = name;
+
+        if (comma == NULL) {
+            return inputs;
+        }
+
+        name = comma + 1;
+    }
+}
+
+static void repl(CloxVM * const vm) {
     for (;;) {
         printf("> ");
         char *line = clox_read_line();
-        clox_vm_interpret(line);
+
+        if (line[0] == '\0' && feof(stdin)) {
+            free(line);
+            printf("\n");
+            return;
+        }
+
+        clox_vm_interpret(vm, line);
         free(line);
     }
 }
 
-static void run_file(const char * const path) {
-    char *contents = clox_read_file(path);
-    CloxInterpretResult result = clox_vm_interpret(contents);
-    free(contents);
+// Evaluates every line of standard input as an expression of its own, for
+// feeding clox large numbers of expressions from another program. Lines are
+// split in place in big blocks, a single chunk is compiled into over and over,
+// and the VM holds on to results to write them out in blocks. Bad lines are
+// reported and skipped, and the exit status reflects the first of them.
+static CloxInterpretResult batch(CloxVM * const vm) {
+    clox_vm_set_output_batching(vm, true);
+
+    CloxLineReader reader;
+    clox_line_reader_init(&reader, STDIN_FILENO);
+
+    CloxChunk chunk;
+    clox_chunk_init(&chunk);
+
+    CloxInterpretResult status = INTERPRET_OK;
+    char *line;
+
+    while ((line = clox_line_reader_next(&reader)) != NULL) {
+        if (line[0] == '\0') {
+            continue;
+        }
+
+        CloxInterpretResult result = INTERPRET_COMPILE_ERROR;
+
+        if (clox_compiler_compile(line, &chunk)) {
+            result = clox_vm_interpret_chunk(vm, &chunk);
+        }
+
+        if (status == INTERPRET_OK) {
+            status = result;
+        }
+
+        clox_chunk_reset(&chunk);
+    }
+
+    clox_chunk_free(&chunk);
+    clox_line_reader_free(&reader);
+    clox_vm_set_output_batching(vm, false);
+    fflush(stdout);
+
+    return status;
+}
+
+static void print_mem_stats(void) {
+    fflush(stdout);
+    clox_mem_stats_print(stderr);
+}
+
+static CloxProfile *profile = NULL;
+
+static void print_profile(void) {
+    fflush(stdout);
+    clox_profile_print(profile, stderr);
+    clox_profile_free(profile);
+}
 
+static void exit_on_error(CloxInterpretResult result) {
     if (result == INTERPRET_COMPILE_ERROR) {
         exit(CLOX_EXIT_COMPILE_ERROR);
     }
@@ -43,6 +175,125 @@ static void run_file(const char * const path) {
     }
 }
 
+static void run_bytecode(CloxVM * const vm, const char * const path) {
+    CloxBytecodeImage image;
+
+    if (!clox_bytecode_load(&image, path)) {
+        exit(CLOX_EXIT_FILE_ERROR);
+    }
+
+    CloxInterpretResult result = clox_vm_interpret_chunk(vm, &image.chunk);
+    clox_bytecode_unload(&image);
+
+    exit_on_error(result);
+}
+
+// Compiles the script at `path` into `chunk`, with "-" streaming it from
+// standard input. The chunk is built in an arena and then compacted into a
+// single block, and it keeps no pointers into the source, so the file and
+// everything compilation allocated are released before the code runs.
+static void compile_source(const char * const path, const CloxInputNames * const inputs, CloxChunk * const chunk) {
+    CloxArena arena;
+    clox_arena_init(&arena);
+    clox_chunk_init_arena(chunk, &arena);
+
+    bool compiled;
+
+    if (strcmp(path, "-") == 0) {
+        if (inputs->count > 0) {
+            fprintf(stderr, "--inputs can't be used with a script on standard input.\n");
+            exit(CLOX_EXIT_USAGE_ERROR);
+        }
+
+        compiled = clox_compiler_compile_stream(STDIN_FILENO, chunk);
+    } else {
+        CloxSource source;
+        clox_source_open(&source, path);
+
+        compiled = clox_compiler_compile_inputs(source.text, inputs->names, inputs->count, chunk);
+        clox_source_close(&source);
+    }
+
+    if (compiled) {
+        clox_chunk_compact(chunk);
+    }
+
+    clox_arena_free(&arena);
+
+    if (!compiled) {
+        exit(CLOX_EXIT_COMPILE_ERROR);
+    }
+}
+
+static void run_file(CloxVM * const vm, const char * const path) {
+    if (clox_bytecode_is_image(path)) {
+        run_bytecode(vm, path);
+        return;
+    }
+
+    const CloxInputNames inputs = { { NULL }, 0 };
+    CloxChunk chunk;
+    compile_source(path, &inputs, &chunk);
+
+    CloxInterpretResult result = clox_vm_interpret_chunk(vm, &chunk);
+    clox_chunk_free(&chunk);
+
+    exit_on_error(result);
+}
+
+static void compile_file(const char * const path, const CloxInputNames * const inputs, const char * const output) {
+    CloxChunk chunk;
+    compile_source(path, inputs, &chunk);
+
+    bool written = clox_bytecode_write(&chunk, output);
+    clox_chunk_free(&chunk);
+
+    if (!written) {
+        exit(CLOX_EXIT_FILE_ERROR);
+    }
+}
+
+// Writes the script or bytecode file at `path` out as C. The input names only
+// go into comments, so they are left out for a bytecode file, which doesn't
+// record them.
+static void emit_c_file(const char * const path, const CloxInputNames * const inputs, const char * const output) {
+    CloxBytecodeImage image;
+    CloxChunk chunk;
+    const bool isImage = clox_bytecode_is_image(path);
+
+    if (isImage) {
+        if (!clox_bytecode_load(&image, path)) {
+            exit(CLOX_EXIT_FILE_ERROR);
+        }
+    } else {
+        compile_source(path, inputs, &chunk);
+    }
+
+    const CloxChunk * const compiled = isImage ? &image.chunk : &chunk;
+    const bool numbers = clox_chunk_numbers_only(compiled);
+    bool written = false;
+
+    if (numbers) {
+        written = clox_emit_c_write(compiled, isImage ? NULL : inputs->names, output);
+    } else {
+        fprintf(stderr, "Only expressions over numbers can be written as C.\n");
+    }
+
+    if (isImage) {
+        clox_bytecode_unload(&image);
+    } else {
+        clox_chunk_free(&chunk);
+    }
+
+    if (!numbers) {
+        exit(CLOX_EXIT_COMPILE_ERROR);
+    }
+
+    if (!written) {
+        exit(CLOX_EXIT_FILE_ERROR);
+    }
+}
+
 int main(int argc, char *argv[]) {
     const char * const progname = argv[0];
 
@@ -57,20 +308,83 @@ int main(int argc, char *argv[]) {
         print_version(progname);
     }
 
-    clox_vm_init();
+    // Registered first so it runs after everything else, and also on the
+    // exit() calls that error paths take.
+    if (options.mem_stats) {
+        atexit(print_mem_stats);
+    }
+
+    CloxInputNames inputs = { { NULL }, 0 };
+
+    if (options.inputs != NULL) {
+        if (!options.compile_only && !options.emit_c) {
+            fprintf(stderr, "--inputs only applies to --compile-only and --emit-c.\n");
+            exit(CLOX_EXIT_USAGE_ERROR);
+        }
+
+        inputs = parse_inputs(options.inputs);
+    }
+
+    if (options.compile_only || options.emit_c) {
+        if (options.output == NULL || options.index != argc - 1 || (options.compile_only && options.emit_c)) {
+            fprintf(stderr, "Usage: %s --compile-only|--emit-c [--inputs <names>] --output <file> <path>\n", progname);
+            exit(CLOX_EXIT_USAGE_ERROR);
+        }
+
+        if (options.emit_c) {
+            emit_c_file(argv[options.index], &inputs, options.output);
+        } else {
+            compile_file(argv[options.index], &inputs, options.output);
+        }
+
+        return 0;
+    }
+
+    CloxVM * const vm = clox_vm_new();
+
+    if (options.profile) {
+        profile = clox_profile_new();
+        clox_vm_set_profile(vm, profile);
+        atexit(print_profile);
+    }
+
+    if (options.printf_numbers) {
+        clox_vm_set_number_format(vm, CLOX_NUMBER_FORMAT_PRINTF);
+    }
+
+    if (options.jit) {
+        clox_vm_set_jit(vm, CLOX_VM_JIT_HOT_RUNS);
+    }
+
+    if (options.stack_max != NULL) {
+        clox_vm_set_stack_max(vm, parse_size("--stack-max", options.stack_max));
+    }
+
+    if (options.batch) {
+        if (options.index != argc) {
+            fprintf(stderr, "Usage: %s --batch < expressions\n", progname);
+            clox_vm_free(vm);
+            exit(CLOX_EXIT_USAGE_ERROR);
+        }
+
+        CloxInterpretResult result = batch(vm);
+        clox_vm_free(vm);
+        exit_on_error(result);
+        return 0;
+    }
 
     if (options.index == argc) {
-        repl();
+        repl(vm);
     } else if (options.index == argc - 1) {
         char *scriptPath = argv[options.index];
-        run_file(scriptPath);
+        run_file(vm, scriptPath);
     } else {
         fprintf(stderr, "Usage: %s [path]\n", progname);
-        clox_vm_free();
+        clox_vm_free(vm);
         exit(CLOX_EXIT_USAGE_ERROR);
     }
 
-    clox_vm_free();
+    clox_vm_free(vm);
 
     return 0;
 }
@@ -1,16 +1,231 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "memory.h"
 
 void *reallocate(void *previous, size_t oldSize, size_t newSize) {
+    // Only needed by the accounting in clox_reallocate_tracked.
+    (void)oldSize;
+
     if (newSize == 0) {
         free(previous);
         return NULL;
     }
 
-    if (oldSize == 0) {
-        // New allocation
+    return realloc(previous, newSize);
+}
+
+#ifdef CLOX_MEM_STATS
+// Requested sizes are bucketed by powers of two, from 16 bytes and under up
+// to 1 MiB, with a last bucket for anything larger.
+#define HISTOGRAM_MIN_SHIFT 4
+#define HISTOGRAM_BUCKETS 18
+
+typedef struct CloxSiteStats CloxSiteStats;
+struct CloxSiteStats {
+    atomic_size_t allocations;
+    atomic_size_t frees;
+    atomic_size_t growths;
+    atomic_size_t live;
+    atomic_size_t peak;
+    atomic_size_t histogram[HISTOGRAM_BUCKETS];
+};
+
+static CloxSiteStats site_stats[CLOX_ALLOC_SITE_COUNT];
+static atomic_size_t total_live;
+static atomic_size_t total_peak;
+
+static const char * const site_names[CLOX_ALLOC_SITE_COUNT] = {
+    [CLOX_ALLOC_CHUNK_CODE] = "chunk code",
+    [CLOX_ALLOC_CHUNK_LINES] = "line table",
+    [CLOX_ALLOC_CONSTANTS] = "constants",
+    [CLOX_ALLOC_CONSTANT_INDEX] = "constant index",
+    [CLOX_ALLOC_COMPACT_CHUNK] = "compacted chunks",
+    [CLOX_ALLOC_OPTIMIZER] = "optimizer",
+    [CLOX_ALLOC_ARENA] = "arena blocks",
+    [CLOX_ALLOC_VM] = "vm stack",
+    [CLOX_ALLOC_IO] = "i/o buffers",
+    [CLOX_ALLOC_PROFILER] = "profiler"
+};
+
+static void raise_peak(atomic_size_t * const peak, size_t value) {
+    size_t current = atomic_load_explicit(peak, memory_order_relaxed);
+
+    while (value > current
+            && !atomic_compare_exchange_weak_explicit(peak, &current, value, memory_order_relaxed, memory_order_relaxed)) {
     }
+}
 
-    return realloc(previous, newSize);
+static int histogram_bucket(size_t size) {
+    int bucket = 0;
+
+    while (bucket < HISTOGRAM_BUCKETS - 1 && size > ((size_t)1 << (bucket + HISTOGRAM_MIN_SHIFT))) {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+// reallocate() that also records the call against `site`. Counters are
+// updated atomically, as VMs on different threads share them.
+void *clox_reallocate_tracked(CloxAllocSite site, void *previous, size_t oldSize, size_t newSize) {
+    CloxSiteStats * const stats = &site_stats[site];
+
+    if (previous == NULL) {
+        oldSize = 0;
+    }
+
+    if (newSize == 0) {
+        if (previous != NULL) {
+            atomic_fetch_add_explicit(&stats->frees, 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_fetch_add_explicit(oldSize == 0 ? &stats->allocations : &stats->growths, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&stats->histogram[histogram_bucket(newSize)], 1, memory_order_relaxed);
+    }
+
+    if (newSize >= oldSize) {
+        size_t grown = newSize - oldSize;
+        raise_peak(&stats->peak, atomic_fetch_add_explicit(&stats->live, grown, memory_order_relaxed) + grown);
+        raise_peak(&total_peak, atomic_fetch_add_explicit(&total_live, grown, memory_order_relaxed) + grown);
+    } else {
+        atomic_fetch_sub_explicit(&stats->live, oldSize - newSize, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&total_live, oldSize - newSize, memory_order_relaxed);
+    }
+
+    return reallocate(previous, oldSize, newSize);
+}
+
+void clox_mem_stats_print(FILE * const out) {
+    fprintf(out, "== memory ==\n");
+    fprintf(out, "%-18s %10s %10s %10s %12s %12s\n", "site", "allocs", "growths", "frees", "live", "peak");
+
+    for (int site = 0; site < CLOX_ALLOC_SITE_COUNT; site++) {
+        CloxSiteStats * const stats = &site_stats[site];
+
+        fprintf(
+            out,
+            "%-18s %10zu %10zu %10zu %12zu %12zu\n",
+            site_names[site],
+            atomic_load(&stats->allocations),
+            atomic_load(&stats->growths),
+            atomic_load(&stats->frees),
+            atomic_load(&stats->live),
+            atomic_load(&stats->peak));
+    }
+
+    fprintf(out, "%-18s %45zu %12zu\n", "total", atomic_load(&total_live), atomic_load(&total_peak));
+
+    fprintf(out, "\n== request sizes (allocations and growths) ==\n");
+
+    for (int site = 0; site < CLOX_ALLOC_SITE_COUNT; site++) {
+        bool printedName = false;
+
+        for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            size_t count = atomic_load(&site_stats[site].histogram[bucket]);
+
+            if (count == 0) {
+                continue;
+            }
+
+            if (!printedName) {
+                fprintf(out, "%s\n", site_names[site]);
+                printedName = true;
+            }
+
+            if (bucket == HISTOGRAM_BUCKETS - 1) {
+                fprintf(out, "  >  %9zu B %10zu\n", (size_t)1 << (bucket - 1 + HISTOGRAM_MIN_SHIFT), count);
+            } else {
+                fprintf(out, "  <= %9zu B %10zu\n", (size_t)1 << (bucket + HISTOGRAM_MIN_SHIFT), count);
+            }
+        }
+    }
+}
+#else
+void clox_mem_stats_print(FILE * const out) {
+    fprintf(out, "Memory statistics are not available, rebuild with -Dmem_stats=true.\n");
+}
+#endif
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGN(size) \
+    (((size) + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1))
+
+struct CloxArenaBlock {
+    CloxArenaBlock *next;
+    size_t size;
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+void clox_arena_init(CloxArena * const arena) {
+    arena->blocks = NULL;
+    arena->last = NULL;
+}
+
+static void *arena_allocate(CloxArena * const arena, size_t size) {
+    size = ARENA_ALIGN(size);
+    CloxArenaBlock *block = arena->blocks;
+
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = (CloxArenaBlock *)CLOX_REALLOCATE(CLOX_ALLOC_ARENA, NULL, 0, sizeof(CloxArenaBlock) + blockSize);
+        block->next = arena->blocks;
+        block->size = blockSize;
+        block->used = 0;
+        arena->blocks = block;
+    }
+
+    void *allocation = block->data + block->used;
+    block->used += size;
+    arena->last = allocation;
+    return allocation;
+}
+
+// Works like reallocate() on memory owned by `arena`.
+void *clox_arena_reallocate(CloxArena * const arena, void *previous, size_t oldSize, size_t newSize) {
+    CloxArenaBlock * const block = arena->blocks;
+    bool isLast = previous != NULL && previous == arena->last;
+
+    if (isLast) {
+        size_t start = (size_t)((unsigned char *)previous - block->data);
+
+        if (ARENA_ALIGN(newSize) <= block->size - start) {
+            block->used = start + ARENA_ALIGN(newSize);
+
+            if (newSize == 0) {
+                arena->last = NULL;
+                return NULL;
+            }
+
+            return previous;
+        }
+    }
+
+    if (newSize == 0) {
+        return NULL;
+    }
+
+    void *allocation = arena_allocate(arena, newSize);
+
+    if (previous != NULL) {
+        memcpy(allocation, previous, oldSize < newSize ? oldSize : newSize);
+    }
+
+    return allocation;
+}
+
+void clox_arena_free(CloxArena * const arena) {
+    CloxArenaBlock *block = arena->blocks;
+
+    while (block != NULL) {
+        CloxArenaBlock *next = block->next;
+        CLOX_REALLOCATE(CLOX_ALLOC_ARENA, block, sizeof(CloxArenaBlock) + block->size, 0);
+        block = next;
+    }
+
+    clox_arena_init(arena);
 }
@@ -0,0 +1,504 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <float.h>
+#include <locale.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+#include "number_tables.h"
+#include "errors.h"
+#include "memory.h"
+
+// Decimal digits that always fit in a uint64_t.
+#define MAX_DIGITS 19
+
+// Integers up to 2^53 are exact doubles.
+#define MAX_EXACT_INTEGER (UINT64_C(1) << 53)
+
+// Literals this long or shorter are copied to the stack for strtod().
+#define SHORT_LITERAL 64
+
+// Powers of ten that are exact doubles.
+static const double exact_powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define MAX_EXACT_POWER 22
+
+// The C locale, made on first use. Threads may race to make it; the losers
+// free theirs and use the winner's.
+static _Atomic(locale_t) c_locale = (locale_t)0;
+
+static locale_t get_c_locale(void) {
+    locale_t current = atomic_load_explicit(&c_locale, memory_order_acquire);
+
+    if (current == (locale_t)0) {
+        locale_t made = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+
+        if (made == (locale_t)0) {
+            return made;
+        }
+
+        if (atomic_compare_exchange_strong_explicit(
+                &c_locale, &current, made, memory_order_acq_rel, memory_order_acquire)) {
+            current = made;
+        } else {
+            freelocale(made);
+        }
+    }
+
+    return current;
+}
+
+// strtod() reads the decimal point from LC_NUMERIC, so it is called with the
+// thread switched to the C locale for the duration.
+static double parse_slow(const char * const start, int length) {
+    char buffer[SHORT_LITERAL + 1];
+    char *text = buffer;
+
+    if (length > SHORT_LITERAL) {
+        text = (char*)CLOX_REALLOCATE(CLOX_ALLOC_IO, NULL, 0, (size_t)length + 1);
+
+        if (text == NULL) {
+            fprintf(stderr, "OUT OF MEMORY in clox_number_parse\n");
+            exit(CLOX_EXIT_OOM_ERROR);
+        }
+    }
+
+    memcpy(text, start, (size_t)length);
+    text[length] = '\0';
+
+    const locale_t locale = get_c_locale();
+    locale_t previous = locale != (locale_t)0 ? uselocale(locale) : (locale_t)0;
+    double value = strtod(text, NULL);
+
+    if (previous != (locale_t)0) {
+        uselocale(previous);
+    }
+
+    if (text != buffer) {
+        CLOX_REALLOCATE(CLOX_ALLOC_IO, text, (size_t)length + 1, 0);
+    }
+
+    return value;
+}
+
+// The literal is read as an integer `digits` times 10^`exponent`. When both
+// factors are exact doubles the product or quotient is rounded only once, so
+// it is the correctly rounded result (Clinger's fast path), which covers
+// nearly every literal written by hand or printed by a program. Anything else
+// goes to strtod().
+double clox_number_parse(const char * const start, int length) {
+    uint64_t digits = 0;
+    int count = 0;
+    int exponent = 0;
+    bool inexact = false;
+    bool fraction = false;
+
+    for (int i = 0; i < length; i++) {
+        char c = start[i];
+
+        if (c == '.') {
+            fraction = true;
+            continue;
+        }
+
+        int digit = c - '0';
+
+        if (count < MAX_DIGITS) {
+            // Leading zeros aren't significant, so they don't use up digits.
+            if (digits != 0 || digit != 0) {
+                digits = digits * 10 + (uint64_t)digit;
+                count++;
+            }
+
+            exponent -= fraction;
+        } else {
+            // Digits past what fits are dropped; only zeros can be dropped
+            // without changing the value.
+            inexact |= digit != 0;
+            exponent += !fraction;
+        }
+    }
+
+    if (digits == 0) {
+        return 0.0;
+    }
+
+    // Where intermediate results are kept at a wider precision (x87), the
+    // single rounding isn't guaranteed, so there is no fast path.
+#if FLT_EVAL_METHOD == 0
+    if (!inexact && digits <= MAX_EXACT_INTEGER) {
+        if (exponent >= 0 && exponent <= MAX_EXACT_POWER) {
+            return (double)digits * exact_powers[exponent];
+        }
+
+        if (exponent < 0 && exponent >= -MAX_EXACT_POWER) {
+            return (double)digits / exact_powers[-exponent];
+        }
+    }
+#endif
+
+    return parse_slow(start, length);
+}
+
+// Formatting is Ryu (Ulf Adams, "Ryu: fast float-to-string conversion", PLDI
+// 2018): the bounds of the interval of reals that round to the double are
+// scaled to a power of ten with 128-bit multiplications by the generated
+// tables, and digits dropped from them for as long as they still differ.
+
+#define MANTISSA_BITS 52
+#define EXPONENT_BITS 11
+#define EXPONENT_BIAS 1023
+
+// Exponents from -6 up to 20 are written out in full, the way JavaScript does.
+#define FIXED_MIN_EXPONENT (-6)
+#define FIXED_MAX_EXPONENT 20
+
+typedef struct Decimal Decimal;
+struct Decimal {
+    uint64_t digits;
+    int exponent;
+};
+
+// floor(log2(5^e)) + 1, for 0 <= e <= 3528.
+static int pow5_bits(int e) {
+    return (int)(((uint32_t)e * 1217359u) >> 19) + 1;
+}
+
+// floor(log10(2^e)), for 0 <= e <= 1650.
+static uint32_t log10_pow2(int e) {
+    return ((uint32_t)e * 78913u) >> 18;
+}
+
+// floor(log10(5^e)), for 0 <= e <= 2620.
+static uint32_t log10_pow5(int e) {
+    return ((uint32_t)e * 732923u) >> 20;
+}
+
+static bool is_multiple_of_pow5(uint64_t value, uint32_t p) {
+    uint32_t count = 0;
+
+    while (value % 5 == 0) {
+        value /= 5;
+        count++;
+    }
+
+    return count >= p;
+}
+
+static bool is_multiple_of_pow2(uint64_t value, uint32_t p) {
+    return (value & ((UINT64_C(1) << p) - 1)) == 0;
+}
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 uint128;
+
+// (m * mul) >> j, where mul is a 128-bit table entry and 64 < j < 128.
+static uint64_t mul_shift(uint64_t m, const uint64_t * const mul, int j) {
+    uint128 low = (uint128)m * mul[0];
+    uint128 high = (uint128)m * mul[1];
+    return (uint64_t)(((low >> 64) + high) >> (j - 64));
+}
+#else
+// The full product of a and b, from 32-bit halves.
+static uint64_t multiply_128(uint64_t a, uint64_t b, uint64_t * const high) {
+    const uint64_t a_low = (uint32_t)a, a_high = a >> 32;
+    const uint64_t b_low = (uint32_t)b, b_high = b >> 32;
+    const uint64_t low_low = a_low * b_low;
+    const uint64_t low_high = a_low * b_high;
+    const uint64_t high_low = a_high * b_low;
+    const uint64_t middle = (low_low >> 32) + (uint32_t)low_high + (uint32_t)high_low;
+
+    *high = a_high * b_high + (low_high >> 32) + (high_low >> 32) + (middle >> 32);
+    return (middle << 32) | (uint32_t)low_low;
+}
+
+static uint64_t mul_shift(uint64_t m, const uint64_t * const mul, int j) {
+    uint64_t high0, high1;
+    multiply_128(m, mul[0], &high0);
+    const uint64_t low1 = multiply_128(m, mul[1], &high1);
+    const uint64_t sum = high0 + low1;
+    high1 += sum < high0;
+
+    const int shift = j - 64;
+    return (high1 << (64 - shift)) | (sum >> shift);
+}
+#endif
+
+// Integers below 2^53 convert without any of the scaling, which is the common
+// case for results of arithmetic on literals.
+static bool small_integer(uint64_t m2, int e2, Decimal * const decimal) {
+    if (e2 > 0 || e2 < -MANTISSA_BITS) {
+        return false;
+    }
+
+    uint64_t fraction = m2 & ((UINT64_C(1) << -e2) - 1);
+
+    if (fraction != 0) {
+        return false;
+    }
+
+    decimal->digits = m2 >> -e2;
+    decimal->exponent = 0;
+
+    while (decimal->digits % 10 == 0) {
+        decimal->digits /= 10;
+        decimal->exponent++;
+    }
+
+    return true;
+}
+
+// The shortest decimal in the rounding interval of the finite, non-zero
+// double with these fields.
+static Decimal shortest(uint64_t mantissa, uint32_t biased_exponent) {
+    int e2;
+    uint64_t m2;
+
+    if (biased_exponent == 0) {
+        e2 = 1 - EXPONENT_BIAS - MANTISSA_BITS;
+        m2 = mantissa;
+    } else {
+        e2 = (int)biased_exponent - EXPONENT_BIAS - MANTISSA_BITS;
+        m2 = (UINT64_C(1) << MANTISSA_BITS) | mantissa;
+    }
+
+    Decimal decimal;
+
+    if (small_integer(m2, e2, &decimal)) {
+        return decimal;
+    }
+
+    // The interval is [mm, mp] around mv, all scaled by 4 so that the
+    // halfway points are integers. Its ends belong to it when m2 is even, as
+    // round-to-even then reads them back as this double.
+    e2 -= 2;
+    const bool accept_bounds = (m2 & 1) == 0;
+    const uint64_t mv = 4 * m2;
+    // The gap below is half as wide at the low end of a binade.
+    const uint32_t mm_shift = mantissa != 0 || biased_exponent <= 1;
+
+    uint64_t vr, vp, vm;
+    int e10;
+    bool vm_trailing_zeros = false;
+    bool vr_trailing_zeros = false;
+
+    if (e2 >= 0) {
+        const uint32_t q = log10_pow2(e2) - (e2 > 3);
+        const int k = CLOX_POW5_INV_BITCOUNT + pow5_bits((int)q) - 1;
+        const int i = -e2 + (int)q + k;
+        const uint64_t * const mul = clox_pow5_inv_split[q];
+
+        e10 = (int)q;
+        vr = mul_shift(4 * m2, mul, i);
+        vp = mul_shift(4 * m2 + 2, mul, i);
+        vm = mul_shift(4 * m2 - 1 - mm_shift, mul, i);
+
+        // Whether the digits that the scaling shifted out were all zeros
+        // matters only for exact multiples of 10^q.
+        if (q <= 21) {
+            if (mv % 5 == 0) {
+                vr_trailing_zeros = is_multiple_of_pow5(mv, q);
+            } else if (accept_bounds) {
+                vm_trailing_zeros = is_multiple_of_pow5(mv - 1 - mm_shift, q);
+            } else {
+                vp -= is_multiple_of_pow5(mv + 2, q);
+            }
+        }
+    } else {
+        const uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+        const int i = -e2 - (int)q;
+        const int k = pow5_bits(i) - CLOX_POW5_BITCOUNT;
+        const int j = (int)q - k;
+        const uint64_t * const mul = clox_pow5_split[i];
+
+        e10 = (int)q + e2;
+        vr = mul_shift(4 * m2, mul, j);
+        vp = mul_shift(4 * m2 + 2, mul, j);
+        vm = mul_shift(4 * m2 - 1 - mm_shift, mul, j);
+
+        if (q <= 1) {
+            vr_trailing_zeros = true;
+
+            if (accept_bounds) {
+                vm_trailing_zeros = mm_shift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 63) {
+            vr_trailing_zeros = is_multiple_of_pow2(mv, q);
+        }
+    }
+
+    int removed = 0;
+    uint64_t output;
+
+    if (vm_trailing_zeros || vr_trailing_zeros) {
+        // Exact values need the full treatment of ties and of the lower
+        // bound, which is rare.
+        uint8_t last_removed = 0;
+
+        while (vp / 10 > vm / 10) {
+            vm_trailing_zeros &= vm % 10 == 0;
+            vr_trailing_zeros &= last_removed == 0;
+            last_removed = (uint8_t)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+
+        if (vm_trailing_zeros) {
+            while (vm % 10 == 0) {
+                vr_trailing_zeros &= last_removed == 0;
+                last_removed = (uint8_t)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+
+        // An exact tie rounds to even.
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0) {
+            last_removed = 4;
+        }
+
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+    } else {
+        bool round_up = false;
+
+        // Most doubles lose at least two digits, so try that first.
+        if (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+
+        while (vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+
+        output = vr + (vr == vm || round_up);
+    }
+
+    decimal.digits = output;
+    decimal.exponent = e10 + removed;
+    return decimal;
+}
+
+static const char digit_pairs[200] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes the decimal digits of `value` to `buffer`, returning how many.
+static int write_digits(uint64_t value, char * const buffer) {
+    char digits[20];
+    char *p = digits + sizeof(digits);
+
+    while (value >= 100) {
+        p -= 2;
+        memcpy(p, &digit_pairs[(value % 100) * 2], 2);
+        value /= 100;
+    }
+
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[value * 2], 2);
+    } else {
+        *--p = (char)('0' + value);
+    }
+
+    int count = (int)(digits + sizeof(digits) - p);
+    memcpy(buffer, p, (size_t)count);
+    return count;
+}
+
+// Lays out `count` digits scaled by 10^`exponent` as a plain number or in
+// exponent form.
+static int layout(const char * const digits, int count, int exponent, char * const buffer) {
+    // The power of ten of the leading digit.
+    const int leading = count + exponent - 1;
+    char *p = buffer;
+
+    if (leading >= FIXED_MIN_EXPONENT && leading <= FIXED_MAX_EXPONENT) {
+        if (leading < 0) {
+            *p++ = '0';
+            *p++ = '.';
+            memset(p, '0', (size_t)(-leading - 1));
+            p += -leading - 1;
+            memcpy(p, digits, (size_t)count);
+            p += count;
+        } else if (leading + 1 >= count) {
+            memcpy(p, digits, (size_t)count);
+            p += count;
+            memset(p, '0', (size_t)(leading + 1 - count));
+            p += leading + 1 - count;
+        } else {
+            memcpy(p, digits, (size_t)(leading + 1));
+            p += leading + 1;
+            *p++ = '.';
+            memcpy(p, digits + leading + 1, (size_t)(count - leading - 1));
+            p += count - leading - 1;
+        }
+    } else {
+        *p++ = digits[0];
+
+        if (count > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, (size_t)(count - 1));
+            p += count - 1;
+        }
+
+        *p++ = 'e';
+        *p++ = leading < 0 ? '-' : '+';
+        p += write_digits((uint64_t)(leading < 0 ? -leading : leading), p);
+    }
+
+    *p = '\0';
+    return (int)(p - buffer);
+}
+
+int clox_number_format(double value, char * const buffer) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const bool negative = (bits >> (MANTISSA_BITS + EXPONENT_BITS)) != 0;
+    const uint64_t mantissa = bits & ((UINT64_C(1) << MANTISSA_BITS) - 1);
+    const uint32_t biased_exponent = (uint32_t)(bits >> MANTISSA_BITS) & ((1u << EXPONENT_BITS) - 1);
+    char *p = buffer;
+
+    if (negative) {
+        *p++ = '-';
+    }
+
+    if (biased_exponent == (1u << EXPONENT_BITS) - 1) {
+        memcpy(p, mantissa != 0 ? "nan" : "inf", 4);
+        return (int)(p - buffer) + 3;
+    }
+
+    if (biased_exponent == 0 && mantissa == 0) {
+        memcpy(p, "0", 2);
+        return (int)(p - buffer) + 1;
+    }
+
+    Decimal decimal = shortest(mantissa, biased_exponent);
+    char digits[20];
+    int count = write_digits(decimal.digits, digits);
+
+    return (int)(p - buffer) + layout(digits, count, decimal.exponent, p);
+}
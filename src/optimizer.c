@@ -0,0 +1,350 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "optimizer.h"
+#include "chunk.h"
+#include "memory.h"
+#include "value.h"
+
+#define NO_CONSTANT -1
+
+// A decoded instruction, with constant operands resolved to their value so
+// that rewriting never has to care about pool slots or operand encodings.
+// `slot` is the operand of OP_INPUT.
+typedef struct CloxInstruction CloxInstruction;
+struct CloxInstruction {
+    uint8_t opcode;
+    bool has_constant;
+    CloxValue constant;
+    uint8_t slot;
+    int line;
+};
+
+typedef struct CloxInstructionList CloxInstructionList;
+struct CloxInstructionList {
+    int count;
+    int capacity;
+    CloxInstruction *instructions;
+};
+
+static void list_init(CloxInstructionList * const list) {
+    list->count = 0;
+    list->capacity = 0;
+    list->instructions = NULL;
+}
+
+static void list_free(CloxInstructionList * const list) {
+    CLOX_FREE_ARRAY(CLOX_ALLOC_OPTIMIZER, CloxInstruction, list->instructions, list->capacity);
+    list_init(list);
+}
+
+static CloxInstruction * tail(CloxInstructionList * const list, int back) {
+    return list->count > back ? &list->instructions[list->count - 1 - back] : NULL;
+}
+
+static bool is_opcode(const CloxInstruction * const instruction, uint8_t opcode) {
+    return instruction != NULL && instruction->opcode == opcode;
+}
+
+// Only numbers are folded; arithmetic on anything else is a runtime error,
+// which has to be left in place to happen.
+static bool is_constant(const CloxInstruction * const instruction) {
+    return is_opcode(instruction, OP_CONSTANT) && CLOX_IS_NUMBER(instruction->constant);
+}
+
+// Whether the value `instruction` leaves on the stack is a number, if it runs
+// without an error: inputs always are, and everything but the nil and boolean
+// literals computes one.
+static bool leaves_number(const CloxInstruction * const instruction) {
+    return instruction != NULL
+        && !is_opcode(instruction, OP_NIL)
+        && !is_opcode(instruction, OP_TRUE)
+        && !is_opcode(instruction, OP_FALSE)
+        && (!is_opcode(instruction, OP_CONSTANT) || CLOX_IS_NUMBER(instruction->constant));
+}
+
+static bool same_number(CloxValue a, double b) {
+    return a == CLOX_NUMBER_VAL(b);
+}
+
+static bool is_binary(uint8_t opcode) {
+    return opcode == OP_ADD
+        || opcode == OP_SUBTRACT
+        || opcode == OP_MULTIPLY
+        || opcode == OP_DIVIDE;
+}
+
+static double evaluate_binary(uint8_t opcode, double a, double b) {
+    switch (opcode) {
+        case OP_ADD:
+            return a + b;
+
+        case OP_SUBTRACT:
+            return a - b;
+
+        case OP_MULTIPLY:
+            return a * b;
+
+        default:
+            return a / b;
+    }
+}
+
+// Whether `x op constant` always evaluates to exactly `x` for a number x. Note
+// that x + 0.0 is not an identity (-0.0 + 0.0 is 0.0), but x + -0.0 is.
+static bool is_identity(uint8_t opcode, CloxValue constant) {
+    switch (opcode) {
+        case OP_ADD:
+            return same_number(constant, -0.0);
+
+        case OP_SUBTRACT:
+            return same_number(constant, 0.0);
+
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+            return same_number(constant, 1.0);
+
+        default:
+            return false;
+    }
+}
+
+// Tries one rewrite of the instructions at the end of the list, returning
+// whether anything changed.
+static bool reduce(CloxInstructionList * const list) {
+    CloxInstruction * const last = tail(list, 0);
+    CloxInstruction * const second = tail(list, 1);
+    CloxInstruction * const third = tail(list, 2);
+
+    // The operand of a trailing unary or binary operation with a constant
+    // right-hand side ends in `third`.
+    if (is_opcode(last, OP_NEGATE) && is_opcode(second, OP_NEGATE) && leaves_number(third)) {
+        list->count -= 2;
+        return true;
+    }
+
+    if (is_opcode(last, OP_NEGATE) && is_constant(second)) {
+        second->constant = CLOX_NUMBER_VAL(-CLOX_AS_NUMBER(second->constant));
+        second->line = last->line;
+        list->count--;
+        return true;
+    }
+
+    if (last != NULL && is_binary(last->opcode) && is_constant(second) && is_constant(third)) {
+        third->constant = CLOX_NUMBER_VAL(evaluate_binary(
+            last->opcode,
+            CLOX_AS_NUMBER(third->constant),
+            CLOX_AS_NUMBER(second->constant)));
+        third->line = last->line;
+        list->count -= 2;
+        return true;
+    }
+
+    if (last != NULL && is_constant(second) && is_identity(last->opcode, second->constant) && leaves_number(third)) {
+        list->count -= 2;
+        return true;
+    }
+
+    return false;
+}
+
+static void push(CloxInstructionList * const list, CloxInstruction instruction) {
+    if (list->capacity < list->count + 1) {
+        int oldCapacity = list->capacity;
+        list->capacity = CLOX_GROW_CAPACITY(list->capacity);
+        list->instructions = CLOX_GROW_ARRAY(
+            CLOX_ALLOC_OPTIMIZER,
+            list->instructions,
+            CloxInstruction,
+            oldCapacity,
+            list->capacity);
+    }
+
+    list->instructions[list->count++] = instruction;
+
+    while (reduce(list));
+}
+
+static uint8_t fused_opcode(uint8_t opcode) {
+    switch (opcode) {
+        case OP_ADD:
+            return OP_ADD_CONSTANT;
+
+        case OP_SUBTRACT:
+            return OP_SUBTRACT_CONSTANT;
+
+        case OP_MULTIPLY:
+            return OP_MULTIPLY_CONSTANT;
+
+        case OP_DIVIDE:
+            return OP_DIVIDE_CONSTANT;
+
+        default:
+            return opcode;
+    }
+}
+
+static bool decode(const CloxChunk * const chunk, CloxInstructionList * const list) {
+    for (int offset = 0; offset < chunk->count;) {
+        CloxInstruction instruction = {
+            chunk->code[offset],
+            false,
+            0,
+            0,
+            clox_chunk_get_line(chunk, offset)
+        };
+
+        int index = NO_CONSTANT;
+
+        switch (instruction.opcode) {
+            case OP_CONSTANT:
+                if (offset + 1 >= chunk->count) {
+                    return false;
+                }
+
+                index = chunk->code[offset + 1];
+                offset += 2;
+                break;
+
+            case OP_CONSTANT_LONG:
+                if (offset + 2 >= chunk->count) {
+                    return false;
+                }
+
+                index = (chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+                offset += 3;
+                break;
+
+            case OP_INPUT:
+                if (offset + 1 >= chunk->count) {
+                    return false;
+                }
+
+                instruction.slot = chunk->code[offset + 1];
+                offset += 2;
+                break;
+
+            case OP_NIL:
+            case OP_TRUE:
+            case OP_FALSE:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_NEGATE:
+            case OP_RETURN:
+                offset++;
+                break;
+
+            default:
+                return false;
+        }
+
+        if (index != NO_CONSTANT) {
+            if (index >= chunk->constants.count) {
+                return false;
+            }
+
+            // Both load forms become one, the re-encoding picks the form and
+            // fuses the load into a binary operation it feeds.
+            instruction.opcode = OP_CONSTANT;
+            instruction.has_constant = true;
+            instruction.constant = chunk->constants.values[index];
+        }
+
+        push(list, instruction);
+    }
+
+    return true;
+}
+
+static int constant_loads(const CloxInstructionList * const list) {
+    int count = 0;
+
+    for (int i = 0; i < list->count; i++) {
+        count += list->instructions[i].has_constant;
+    }
+
+    return count;
+}
+
+static bool encode(const CloxInstructionList * const list, CloxChunk * const chunk) {
+    for (int i = 0; i < list->count; i++) {
+        const CloxInstruction * const instruction = &list->instructions[i];
+
+        if (!instruction->has_constant) {
+            clox_chunk_write(chunk, instruction->opcode, instruction->line);
+
+            if (instruction->opcode == OP_INPUT) {
+                clox_chunk_write(chunk, instruction->slot, instruction->line);
+            }
+
+            continue;
+        }
+
+        int index = clox_chunk_add_constant(chunk, instruction->constant);
+
+        if (index > UINT16_MAX) {
+            return false;
+        }
+
+        const CloxInstruction * const next = i + 1 < list->count ? &list->instructions[i + 1] : NULL;
+
+        if (index <= UINT8_MAX && next != NULL && is_binary(next->opcode)) {
+            clox_chunk_write(chunk, fused_opcode(next->opcode), next->line);
+            clox_chunk_write(chunk, (uint8_t)index, next->line);
+            i++;
+            continue;
+        }
+
+        clox_chunk_write_constant(chunk, index, instruction->line);
+    }
+
+    clox_chunk_free_constant_index(chunk);
+    return true;
+}
+
+// Rewrites the chunk in place with a peephole pass: double negations cancel,
+// negated and binary operations on number constants are evaluated, and
+// operations that are an exact identity under IEEE rules (such as * 1) are
+// dropped, as long as no runtime type error goes missing with them. The
+// constant pool and line table are rebuilt to hold only what the remaining
+// code refers to, and short constant loads feeding a binary operation are
+// fused into the operation's constant-operand form. A chunk containing
+// anything the pass doesn't understand is left untouched.
+void clox_optimize_chunk(CloxChunk * const chunk) {
+    CloxInstructionList list;
+    list_init(&list);
+
+    if (!decode(chunk, &list)) {
+        list_free(&list);
+        return;
+    }
+
+    // With no more constant loads than the pool can address, encoding can't
+    // fail, so the chunk's own buffers are reused. Otherwise folding may have
+    // produced more distinct values than fit, and the original has to be kept
+    // around until that is known.
+    int inputCount = chunk->input_count;
+
+    if (constant_loads(&list) <= UINT16_MAX + 1) {
+        clox_chunk_reset(chunk);
+        chunk->input_count = inputCount;
+        encode(&list, chunk);
+        list_free(&list);
+        return;
+    }
+
+    CloxChunk optimized;
+    clox_chunk_init_arena(&optimized, chunk->arena);
+    optimized.input_count = inputCount;
+
+    if (encode(&list, &optimized)) {
+        clox_chunk_free(chunk);
+        *chunk = optimized;
+    } else {
+        clox_chunk_free(&optimized);
+    }
+
+    list_free(&list);
+}
@@ -33,7 +33,17 @@ static CloxOptions options;
 static CloxOptionItem option_items[] = {
     OPT_BOOL('h', "help", &options.help, "Displays this help message and exits."),
     OPT_BOOL('V', "version", &options.version, "Displays version info."),
-    OPT_BOOL('v', "verbose", &options.verbose, "Verbose output.")
+    OPT_BOOL('v', "verbose", &options.verbose, "Verbose output."),
+    OPT_REQUIRED('s', "stack-max", &options.stack_max, "Maximum number of VM stack slots."),
+    OPT_BOOL('c', "compile-only", &options.compile_only, "Compile the file to bytecode instead of running it."),
+    OPT_BOOL('e', "emit-c", &options.emit_c, "Compile the file to a C source file instead of running it."),
+    OPT_REQUIRED('o', "output", &options.output, "Path to write compiled bytecode or C to."),
+    OPT_REQUIRED('i', "inputs", &options.inputs, "Comma-separated names of the inputs the expression reads."),
+    OPT_BOOL('b', "batch", &options.batch, "Evaluate each line of standard input as an expression."),
+    OPT_BOOL('m', "mem-stats", &options.mem_stats, "Print memory allocation statistics on exit."),
+    OPT_BOOL('p', "profile", &options.profile, "Profile execution by opcode and source line, report on exit."),
+    OPT_BOOL('g', "printf-numbers", &options.printf_numbers, "Print numbers with printf's %g instead of in full."),
+    OPT_BOOL('j', "jit", &options.jit, "Compile hot expressions to native x86-64 code; only helps ones that read inputs.")
 };
 
 static const int option_item_count = sizeof(option_items) / sizeof(option_items[0]);
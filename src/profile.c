@@ -0,0 +1,333 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "debug.h"
+#include "memory.h"
+
+// How many of the hottest lines and instructions the report lists.
+#define REPORT_TOP 10
+
+CloxProfile * clox_profile_new() {
+    CloxProfile * const profile = (CloxProfile *)CLOX_REALLOCATE(CLOX_ALLOC_PROFILER, NULL, 0, sizeof(CloxProfile));
+
+    profile->offsets = NULL;
+    profile->offset_capacity = 0;
+    profile->last_offset = -1;
+    profile->last_tick = 0;
+
+    profile->runs = 0;
+    memset(profile->opcodes, 0, sizeof(profile->opcodes));
+    profile->lines = NULL;
+    profile->line_capacity = 0;
+    profile->hotspots = NULL;
+    profile->hotspot_count = 0;
+    profile->hotspot_capacity = 0;
+
+    return profile;
+}
+
+void clox_profile_begin_run(CloxProfile * const profile, const CloxChunk * const chunk) {
+    if (profile->offset_capacity < chunk->count) {
+        int oldCapacity = profile->offset_capacity;
+        profile->offset_capacity = chunk->count;
+        profile->offsets = CLOX_GROW_ARRAY(
+            CLOX_ALLOC_PROFILER,
+            profile->offsets,
+            CloxProfileCounter,
+            oldCapacity,
+            profile->offset_capacity);
+    }
+
+    memset(profile->offsets, 0, sizeof(CloxProfileCounter) * (size_t)chunk->count);
+    profile->last_offset = -1;
+    profile->last_tick = clox_profile_clock();
+}
+
+static void add_counter(CloxProfileCounter * const total, const CloxProfileCounter * const counter) {
+    total->count += counter->count;
+    total->time += counter->time;
+}
+
+static CloxProfileCounter * line_counter(CloxProfile * const profile, int line) {
+    if (line >= profile->line_capacity) {
+        int oldCapacity = profile->line_capacity;
+
+        while (line >= profile->line_capacity) {
+            profile->line_capacity = CLOX_GROW_CAPACITY(profile->line_capacity);
+        }
+
+        profile->lines = CLOX_GROW_ARRAY(
+            CLOX_ALLOC_PROFILER,
+            profile->lines,
+            CloxProfileCounter,
+            oldCapacity,
+            profile->line_capacity);
+        memset(
+            profile->lines + oldCapacity,
+            0,
+            sizeof(CloxProfileCounter) * (size_t)(profile->line_capacity - oldCapacity));
+    }
+
+    return &profile->lines[line];
+}
+
+static uint32_t hotspot_hash(int line, int offset, uint8_t opcode) {
+    uint64_t key = ((uint64_t)(uint32_t)line << 32) ^ ((uint64_t)(uint32_t)offset << 8) ^ opcode;
+    key ^= key >> 33;
+    key *= UINT64_C(0xff51afd7ed558ccd);
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+// Finds the slot of an instruction in the open-addressed hotspot table,
+// growing the table first if adding one might push it past 3/4 full.
+static CloxProfileHotspot * hotspot(CloxProfile * const profile, int line, int offset, uint8_t opcode) {
+    if (profile->hotspot_count + 1 > profile->hotspot_capacity / 4 * 3) {
+        int oldCapacity = profile->hotspot_capacity;
+        CloxProfileHotspot * const oldHotspots = profile->hotspots;
+
+        profile->hotspot_capacity = CLOX_GROW_CAPACITY(profile->hotspot_capacity);
+        profile->hotspots = CLOX_GROW_ARRAY(
+            CLOX_ALLOC_PROFILER,
+            NULL,
+            CloxProfileHotspot,
+            0,
+            profile->hotspot_capacity);
+
+        for (int i = 0; i < profile->hotspot_capacity; i++) {
+            profile->hotspots[i].line = -1;
+        }
+
+        profile->hotspot_count = 0;
+
+        for (int i = 0; i < oldCapacity; i++) {
+            const CloxProfileHotspot * const old = &oldHotspots[i];
+
+            if (old->line != -1) {
+                *hotspot(profile, old->line, old->offset, old->opcode) = *old;
+            }
+        }
+
+        CLOX_FREE_ARRAY(CLOX_ALLOC_PROFILER, CloxProfileHotspot, oldHotspots, oldCapacity);
+    }
+
+    uint32_t mask = (uint32_t)profile->hotspot_capacity - 1;
+    uint32_t slot = hotspot_hash(line, offset, opcode) & mask;
+
+    for (;;) {
+        CloxProfileHotspot * const entry = &profile->hotspots[slot];
+
+        if (entry->line == -1) {
+            entry->line = line;
+            entry->offset = offset;
+            entry->opcode = opcode;
+            entry->counter.count = 0;
+            entry->counter.time = 0;
+            profile->hotspot_count++;
+            return entry;
+        }
+
+        if (entry->line == line && entry->offset == offset && entry->opcode == opcode) {
+            return entry;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Charges the time since the last dispatch to the instruction that returned,
+// then folds the run's per-offset counters into the totals.
+void clox_profile_end_run(CloxProfile * const profile, const CloxChunk * const chunk) {
+    if (profile->last_offset >= 0) {
+        profile->offsets[profile->last_offset].time += clox_profile_clock() - profile->last_tick;
+    }
+
+    profile->runs++;
+
+    for (int offset = 0; offset < chunk->count; offset++) {
+        const CloxProfileCounter * const counter = &profile->offsets[offset];
+
+        if (counter->count == 0) {
+            continue;
+        }
+
+        uint8_t opcode = chunk->code[offset];
+        int line = clox_chunk_get_line(chunk, offset);
+
+        add_counter(&profile->opcodes[opcode], counter);
+        add_counter(line_counter(profile, line), counter);
+        add_counter(&hotspot(profile, line, offset, opcode)->counter, counter);
+    }
+
+    profile->last_offset = -1;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * (double)part / (double)whole;
+}
+
+static int compare_by_time(const CloxProfileCounter * const a, const CloxProfileCounter * const b) {
+    if (a->time != b->time) {
+        return a->time < b->time ? 1 : -1;
+    }
+
+    if (a->count != b->count) {
+        return a->count < b->count ? 1 : -1;
+    }
+
+    return 0;
+}
+
+typedef struct CloxProfileRow CloxProfileRow;
+struct CloxProfileRow {
+    int key;
+    CloxProfileCounter counter;
+};
+
+static int compare_rows(const void *a, const void *b) {
+    const CloxProfileRow * const rowA = (const CloxProfileRow *)a;
+    const CloxProfileRow * const rowB = (const CloxProfileRow *)b;
+    int order = compare_by_time(&rowA->counter, &rowB->counter);
+    return order != 0 ? order : (rowA->key > rowB->key) - (rowA->key < rowB->key);
+}
+
+static int compare_hotspots(const void *a, const void *b) {
+    const CloxProfileHotspot * const hotA = (const CloxProfileHotspot *)a;
+    const CloxProfileHotspot * const hotB = (const CloxProfileHotspot *)b;
+    int order = compare_by_time(&hotA->counter, &hotB->counter);
+
+    if (order != 0) {
+        return order;
+    }
+
+    if (hotA->line != hotB->line) {
+        return hotA->line < hotB->line ? -1 : 1;
+    }
+
+    return (hotA->offset > hotB->offset) - (hotA->offset < hotB->offset);
+}
+
+// Collects the non-empty counters of `counters` into `rows`, hottest first.
+static int sorted_rows(const CloxProfileCounter * const counters, int count, CloxProfileRow * const rows) {
+    int rowCount = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (counters[i].count > 0) {
+            rows[rowCount].key = i;
+            rows[rowCount].counter = counters[i];
+            rowCount++;
+        }
+    }
+
+    qsort(rows, (size_t)rowCount, sizeof(CloxProfileRow), compare_rows);
+    return rowCount;
+}
+
+void clox_profile_print(const CloxProfile * const profile, FILE * const out) {
+    CloxProfileCounter total = { 0, 0 };
+
+    for (int opcode = 0; opcode <= UINT8_MAX; opcode++) {
+        add_counter(&total, &profile->opcodes[opcode]);
+    }
+
+    fprintf(
+        out,
+        "== profile: %llu instructions, %llu " CLOX_PROFILE_CLOCK_UNIT " in %llu runs ==\n",
+        (unsigned long long)total.count,
+        (unsigned long long)total.time,
+        (unsigned long long)profile->runs);
+
+    CloxProfileRow opcodeRows[UINT8_MAX + 1];
+    int opcodeCount = sorted_rows(profile->opcodes, UINT8_MAX + 1, opcodeRows);
+
+    fprintf(out, "%-24s %14s %7s %16s %7s %10s\n", "opcode", "count", "count%", CLOX_PROFILE_CLOCK_UNIT, "time%", "per op");
+
+    for (int i = 0; i < opcodeCount; i++) {
+        const CloxProfileCounter * const counter = &opcodeRows[i].counter;
+
+        fprintf(
+            out,
+            "%-24s %14llu %6.2f%% %16llu %6.2f%% %10.1f\n",
+            clox_opcode_name((uint8_t)opcodeRows[i].key),
+            (unsigned long long)counter->count,
+            percent(counter->count, total.count),
+            (unsigned long long)counter->time,
+            percent(counter->time, total.time),
+            (double)counter->time / (double)counter->count);
+    }
+
+    if (profile->line_capacity > 0) {
+        CloxProfileRow * const lineRows = (CloxProfileRow *)CLOX_REALLOCATE(
+            CLOX_ALLOC_PROFILER,
+            NULL,
+            0,
+            sizeof(CloxProfileRow) * (size_t)profile->line_capacity);
+        int lineCount = sorted_rows(profile->lines, profile->line_capacity, lineRows);
+
+        fprintf(out, "\n== hottest lines ==\n");
+        fprintf(out, "%-24s %14s %7s %16s %7s\n", "line", "count", "count%", CLOX_PROFILE_CLOCK_UNIT, "time%");
+
+        for (int i = 0; i < lineCount && i < REPORT_TOP; i++) {
+            const CloxProfileCounter * const counter = &lineRows[i].counter;
+
+            fprintf(
+                out,
+                "%-24d %14llu %6.2f%% %16llu %6.2f%%\n",
+                lineRows[i].key,
+                (unsigned long long)counter->count,
+                percent(counter->count, total.count),
+                (unsigned long long)counter->time,
+                percent(counter->time, total.time));
+        }
+
+        CLOX_FREE_ARRAY(CLOX_ALLOC_PROFILER, CloxProfileRow, lineRows, profile->line_capacity);
+    }
+
+    if (profile->hotspot_count > 0) {
+        CloxProfileHotspot * const hotspots = CLOX_GROW_ARRAY(
+            CLOX_ALLOC_PROFILER,
+            NULL,
+            CloxProfileHotspot,
+            0,
+            profile->hotspot_count);
+        int hotspotCount = 0;
+
+        for (int i = 0; i < profile->hotspot_capacity; i++) {
+            if (profile->hotspots[i].line != -1) {
+                hotspots[hotspotCount++] = profile->hotspots[i];
+            }
+        }
+
+        qsort(hotspots, (size_t)hotspotCount, sizeof(CloxProfileHotspot), compare_hotspots);
+
+        fprintf(out, "\n== hottest instructions ==\n");
+        fprintf(out, "%-6s %-6s %-20s %10s %7s %16s %7s\n", "line", "offset", "opcode", "count", "count%", CLOX_PROFILE_CLOCK_UNIT, "time%");
+
+        for (int i = 0; i < hotspotCount && i < REPORT_TOP; i++) {
+            const CloxProfileHotspot * const entry = &hotspots[i];
+
+            fprintf(
+                out,
+                "%-6d 0x%04x %-20s %10llu %6.2f%% %16llu %6.2f%%\n",
+                entry->line,
+                entry->offset,
+                clox_opcode_name(entry->opcode),
+                (unsigned long long)entry->counter.count,
+                percent(entry->counter.count, total.count),
+                (unsigned long long)entry->counter.time,
+                percent(entry->counter.time, total.time));
+        }
+
+        CLOX_FREE_ARRAY(CLOX_ALLOC_PROFILER, CloxProfileHotspot, hotspots, profile->hotspot_count);
+    }
+}
+
+void clox_profile_free(CloxProfile * const profile) {
+    CLOX_FREE_ARRAY(CLOX_ALLOC_PROFILER, CloxProfileCounter, profile->offsets, profile->offset_capacity);
+    CLOX_FREE_ARRAY(CLOX_ALLOC_PROFILER, CloxProfileCounter, profile->lines, profile->line_capacity);
+    CLOX_FREE_ARRAY(CLOX_ALLOC_PROFILER, CloxProfileHotspot, profile->hotspots, profile->hotspot_capacity);
+    CLOX_REALLOCATE(CLOX_ALLOC_PROFILER, profile, sizeof(CloxProfile), 0);
+}
@@ -0,0 +1,171 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scan_kernels.h"
+#include "lexer_tables.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CLOX_SCAN_X86
+#include <immintrin.h>
+#endif
+
+static bool is_identifier_char(char c) {
+    return (clox_char_class[(uint8_t)c] & (CLOX_CHAR_ALPHA | CLOX_CHAR_DIGIT)) != 0;
+}
+
+static const char * scalar_whitespace(const char *text, int *line) {
+    while (clox_char_class[(uint8_t)*text] & CLOX_CHAR_BLANK) {
+        *line += *text == '\n';
+        text++;
+    }
+
+    return text;
+}
+
+static const char * scalar_comment(const char *text) {
+    while (*text != '\n' && *text != '\0') {
+        text++;
+    }
+
+    return text;
+}
+
+static const char * scalar_string(const char *text, int *line) {
+    while (*text != '"' && *text != '\0') {
+        if (*text == '\n') {
+            (*line)++;
+        }
+
+        text++;
+    }
+
+    return text;
+}
+
+static const char * scalar_identifier(const char *text) {
+    while (is_identifier_char(*text)) {
+        text++;
+    }
+
+    return text;
+}
+
+static const char * scalar_digits(const char *text) {
+    while (clox_char_class[(uint8_t)*text] & CLOX_CHAR_DIGIT) {
+        text++;
+    }
+
+    return text;
+}
+
+#ifdef CLOX_SCAN_X86
+
+// The kernels read memory around the text that isn't part of any object (see
+// scan_kernels_simd.h), which AddressSanitizer would report.
+#define KERNEL(name) sse2_##name
+#define SIMD_WIDTH 16
+#define SIMD_ALL 0xffffu
+#define SIMD_VECTOR __m128i
+#define SIMD_FUNCTION __attribute__((no_sanitize_address))
+#define SIMD_LOAD(p) _mm_load_si128((const __m128i *)(const void *)(p))
+#define SIMD_SET1 _mm_set1_epi8
+#define SIMD_EQ _mm_cmpeq_epi8
+#define SIMD_GT _mm_cmpgt_epi8
+#define SIMD_OR _mm_or_si128
+#define SIMD_AND _mm_and_si128
+#define SIMD_MOVEMASK _mm_movemask_epi8
+#include "scan_kernels_simd.h"
+#undef KERNEL
+#undef SIMD_WIDTH
+#undef SIMD_ALL
+#undef SIMD_VECTOR
+#undef SIMD_FUNCTION
+#undef SIMD_LOAD
+#undef SIMD_SET1
+#undef SIMD_EQ
+#undef SIMD_GT
+#undef SIMD_OR
+#undef SIMD_AND
+#undef SIMD_MOVEMASK
+
+#define KERNEL(name) avx2_##name
+#define SIMD_WIDTH 32
+#define SIMD_ALL 0xffffffffu
+#define SIMD_VECTOR __m256i
+#define SIMD_FUNCTION __attribute__((no_sanitize_address, target("avx2,popcnt")))
+#define SIMD_LOAD(p) _mm256_load_si256((const __m256i *)(const void *)(p))
+#define SIMD_SET1 _mm256_set1_epi8
+#define SIMD_EQ _mm256_cmpeq_epi8
+#define SIMD_GT _mm256_cmpgt_epi8
+#define SIMD_OR _mm256_or_si256
+#define SIMD_AND _mm256_and_si256
+#define SIMD_MOVEMASK _mm256_movemask_epi8
+#include "scan_kernels_simd.h"
+
+#endif
+
+static const CloxScanKernels kernels[CLOX_SCAN_LEVEL_COUNT] = {
+    [CLOX_SCAN_SCALAR] = {
+        "scalar", scalar_whitespace, scalar_comment, scalar_string, scalar_identifier, scalar_digits
+    },
+#ifdef CLOX_SCAN_X86
+    [CLOX_SCAN_SSE2] = {
+        "sse2", sse2_whitespace, sse2_comment, sse2_string, sse2_identifier, sse2_digits
+    },
+    [CLOX_SCAN_AVX2] = {
+        "avx2", avx2_whitespace, avx2_comment, avx2_string, avx2_identifier, avx2_digits
+    },
+#endif
+};
+
+// Read by every VM, so atomic: the first thread to need kernels picks them,
+// and a clox_scan_kernels_select() made before then wins.
+static const CloxScanKernels * _Atomic selected = NULL;
+
+static bool is_supported(CloxScanLevel level) {
+    if (kernels[level].name == NULL) {
+        return false;
+    }
+
+#ifdef CLOX_SCAN_X86
+    if (level == CLOX_SCAN_AVX2) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    }
+#endif
+
+    return true;
+}
+
+const CloxScanKernels * clox_scan_kernels(void) {
+    const CloxScanKernels *current = atomic_load_explicit(&selected, memory_order_acquire);
+
+    if (current == NULL) {
+        CloxScanLevel level = CLOX_SCAN_LEVEL_COUNT - 1;
+
+        while (!is_supported(level)) {
+            level--;
+        }
+
+        // Losing the race leaves `current` holding the other thread's pick.
+        const CloxScanKernels *widest = &kernels[level];
+
+        if (atomic_compare_exchange_strong_explicit(
+                &selected, &current, widest, memory_order_acq_rel, memory_order_acquire)) {
+            current = widest;
+        }
+    }
+
+    return current;
+}
+
+bool clox_scan_kernels_select(CloxScanLevel level) {
+    if (level >= CLOX_SCAN_LEVEL_COUNT || !is_supported(level)) {
+        return false;
+    }
+
+    atomic_store_explicit(&selected, &kernels[level], memory_order_release);
+    return true;
+}
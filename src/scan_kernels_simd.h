@@ -0,0 +1,143 @@
+// The body of the SIMD scan kernels, included by scan_kernels.c once per
+// instruction set with these defined for it:
+//
+//   KERNEL(name)   the name to give a function for this instruction set
+//   SIMD_WIDTH     bytes per vector
+//   SIMD_ALL       the mask with a bit set for every byte of a vector
+//   SIMD_VECTOR    the vector type
+//   SIMD_FUNCTION  attributes for each function
+//   SIMD_LOAD, SIMD_SET1, SIMD_EQ, SIMD_GT, SIMD_OR, SIMD_AND, SIMD_MOVEMASK
+//
+// Every kernel reads whole aligned vectors. An aligned load can't cross a
+// page boundary, so it never touches a page the text doesn't reach; bytes in
+// the first vector that come before the text are masked out, and no vector is
+// read past the one holding the NUL since the NUL ends every run.
+
+// One bit per byte of `bytes` that is `c`.
+SIMD_FUNCTION static inline uint32_t KERNEL(equal)(SIMD_VECTOR bytes, char c) {
+    return (uint32_t)SIMD_MOVEMASK(SIMD_EQ(bytes, SIMD_SET1(c)));
+}
+
+// One bit per byte of `bytes` that falls in ASCII [low, high]. The comparison
+// is signed, so bytes of 0x80 and up are negative and never in range.
+SIMD_FUNCTION static inline SIMD_VECTOR KERNEL(range)(SIMD_VECTOR bytes, char low, char high) {
+    return SIMD_AND(SIMD_GT(bytes, SIMD_SET1((char)(low - 1))), SIMD_GT(SIMD_SET1((char)(high + 1)), bytes));
+}
+
+// Bits of the bytes from `text` on in the first vector; text - offset is the
+// vector's aligned start.
+static inline uint32_t KERNEL(first_bits)(const char * const text, size_t * const offset) {
+    *offset = (uintptr_t)text % SIMD_WIDTH;
+    return SIMD_ALL << *offset & SIMD_ALL;
+}
+
+SIMD_FUNCTION static const char * KERNEL(whitespace)(const char *text, int *line) {
+    size_t offset;
+    uint32_t valid = KERNEL(first_bits)(text, &offset);
+    const char *block = text - offset;
+    int lines = 0;
+
+    for (;;) {
+        SIMD_VECTOR bytes = SIMD_LOAD(block);
+        uint32_t newlines = KERNEL(equal)(bytes, '\n');
+        uint32_t blanks = newlines | (uint32_t)SIMD_MOVEMASK(SIMD_OR(
+            SIMD_OR(SIMD_EQ(bytes, SIMD_SET1(' ')), SIMD_EQ(bytes, SIMD_SET1('\t'))),
+            SIMD_EQ(bytes, SIMD_SET1('\r'))));
+        uint32_t stop = ~blanks & valid;
+
+        if (stop != 0) {
+            uint32_t before = (stop & (0u - stop)) - 1;
+            *line += lines + __builtin_popcount(newlines & valid & before);
+            return block + __builtin_ctz(stop);
+        }
+
+        lines += __builtin_popcount(newlines & valid);
+        valid = SIMD_ALL;
+        block += SIMD_WIDTH;
+    }
+}
+
+SIMD_FUNCTION static const char * KERNEL(comment)(const char *text) {
+    size_t offset;
+    uint32_t valid = KERNEL(first_bits)(text, &offset);
+    const char *block = text - offset;
+
+    for (;;) {
+        SIMD_VECTOR bytes = SIMD_LOAD(block);
+        uint32_t stop = (uint32_t)SIMD_MOVEMASK(SIMD_OR(
+            SIMD_EQ(bytes, SIMD_SET1('\n')), SIMD_EQ(bytes, SIMD_SET1('\0')))) & valid;
+
+        if (stop != 0) {
+            return block + __builtin_ctz(stop);
+        }
+
+        valid = SIMD_ALL;
+        block += SIMD_WIDTH;
+    }
+}
+
+SIMD_FUNCTION static const char * KERNEL(string)(const char *text, int *line) {
+    size_t offset;
+    uint32_t valid = KERNEL(first_bits)(text, &offset);
+    const char *block = text - offset;
+    int lines = 0;
+
+    for (;;) {
+        SIMD_VECTOR bytes = SIMD_LOAD(block);
+        uint32_t newlines = KERNEL(equal)(bytes, '\n');
+        uint32_t stop = (uint32_t)SIMD_MOVEMASK(SIMD_OR(
+            SIMD_EQ(bytes, SIMD_SET1('"')), SIMD_EQ(bytes, SIMD_SET1('\0')))) & valid;
+
+        if (stop != 0) {
+            uint32_t before = (stop & (0u - stop)) - 1;
+            *line += lines + __builtin_popcount(newlines & valid & before);
+            return block + __builtin_ctz(stop);
+        }
+
+        lines += __builtin_popcount(newlines & valid);
+        valid = SIMD_ALL;
+        block += SIMD_WIDTH;
+    }
+}
+
+SIMD_FUNCTION static const char * KERNEL(identifier)(const char *text) {
+    size_t offset;
+    uint32_t valid = KERNEL(first_bits)(text, &offset);
+    const char *block = text - offset;
+
+    for (;;) {
+        SIMD_VECTOR bytes = SIMD_LOAD(block);
+        // Setting bit 5 folds upper case letters onto lower case ones without
+        // bringing anything else into 'a'..'z'.
+        SIMD_VECTOR letters = KERNEL(range)(SIMD_OR(bytes, SIMD_SET1(0x20)), 'a', 'z');
+        SIMD_VECTOR digits = KERNEL(range)(bytes, '0', '9');
+        uint32_t word = (uint32_t)SIMD_MOVEMASK(SIMD_OR(
+            SIMD_OR(letters, digits), SIMD_EQ(bytes, SIMD_SET1('_'))));
+        uint32_t stop = ~word & valid;
+
+        if (stop != 0) {
+            return block + __builtin_ctz(stop);
+        }
+
+        valid = SIMD_ALL;
+        block += SIMD_WIDTH;
+    }
+}
+
+SIMD_FUNCTION static const char * KERNEL(digits)(const char *text) {
+    size_t offset;
+    uint32_t valid = KERNEL(first_bits)(text, &offset);
+    const char *block = text - offset;
+
+    for (;;) {
+        SIMD_VECTOR bytes = SIMD_LOAD(block);
+        uint32_t stop = ~(uint32_t)SIMD_MOVEMASK(KERNEL(range)(bytes, '0', '9')) & valid;
+
+        if (stop != 0) {
+            return block + __builtin_ctz(stop);
+        }
+
+        valid = SIMD_ALL;
+        block += SIMD_WIDTH;
+    }
+}
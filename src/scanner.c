@@ -1,71 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdbool.h>
-#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "scanner.h"
+#include "errors.h"
+#include "memory.h"
+#include "scan_kernels.h"
+#include "lexer_tables.h"
+
+#define STREAM_WINDOW_SIZE (64 * 1024)
 
-typedef struct CloxScanner CloxScanner;
-struct CloxScanner {
-    const char *start;
-    const char *current;
-    int line;
-} scanner;
+_Static_assert(TOKEN_BANG_EQUAL == TOKEN_BANG + 1 && TOKEN_EQUAL_EQUAL == TOKEN_EQUAL + 1
+    && TOKEN_GREATER_EQUAL == TOKEN_GREATER + 1 && TOKEN_LESS_EQUAL == TOKEN_LESS + 1,
+    "each token that can take an '=' must be followed by its form with one");
 
-static bool isalscore(char c) {
-    return isalpha(c) || c == '_';
+// Character classes come from the generated clox_char_class table, see
+// gen_lexer_tables.py.
+static bool has_class(char c, uint8_t classes) {
+    return (clox_char_class[(uint8_t)c] & classes) != 0;
 }
 
 static bool isalnumscore(char c) {
-    return isalnum(c) || c == '_';
+    return has_class(c, CLOX_CHAR_ALPHA | CLOX_CHAR_DIGIT);
+}
+
+static bool isdigit_ascii(char c) {
+    return has_class(c, CLOX_CHAR_DIGIT);
+}
+
+// Called when the scanner needs `lookahead` characters from `current` on but
+// has run into the NUL at the end of the window. The token being scanned is
+// slid to the front and more input read in behind it; the window only grows
+// when a single token fills all of it, so memory is bounded by the longest
+// token rather than by the input. Returns whether anything was read.
+static bool refill(CloxScanner * const scanner, size_t lookahead) {
+    if (scanner->fd < 0 || scanner->eof) {
+        return false;
+    }
+
+    const char * const end = scanner->window + scanner->window_count;
+
+    if (scanner->current + lookahead <= end) {
+        return false;
+    }
+
+    size_t keep = (size_t)(end - scanner->start);
+    size_t offset = (size_t)(scanner->current - scanner->start);
+    memmove(scanner->window, scanner->start, keep);
+
+    if (keep + 1 == scanner->window_capacity) {
+        size_t capacity = scanner->window_capacity * 2;
+        scanner->window = CLOX_GROW_ARRAY(CLOX_ALLOC_IO, scanner->window, char, scanner->window_capacity, capacity);
+        scanner->window_capacity = capacity;
+    }
+
+    ssize_t bytesRead;
+
+    do {
+        bytesRead = read(scanner->fd, scanner->window + keep, scanner->window_capacity - keep - 1);
+    } while (bytesRead == -1 && errno == EINTR);
+
+    if (bytesRead == -1) {
+        fprintf(stderr, "Failed to read source: %s.\n", strerror(errno));
+        exit(CLOX_EXIT_FILE_ERROR);
+    }
+
+    scanner->eof = bytesRead == 0;
+    scanner->window_count = keep + (size_t)bytesRead;
+    scanner->window[scanner->window_count] = '\0';
+    scanner->start = scanner->window;
+    scanner->current = scanner->window + offset;
+
+    return bytesRead > 0;
 }
 
-static bool is_at_end() {
-    return *scanner.current == '\0';
+static bool is_at_end(CloxScanner * const scanner) {
+    return *scanner->current == '\0' && !refill(scanner, 1);
 }
 
-static char advance() {
-    return *scanner.current++;
+static char advance(CloxScanner * const scanner) {
+    return *scanner->current++;
 }
 
-static bool match(char expected) {
-    if (is_at_end())
+static bool match(CloxScanner * const scanner, char expected) {
+    if (is_at_end(scanner))
         return false;
 
-    if (*scanner.current != expected)
+    if (*scanner->current != expected)
         return false;
 
-    scanner.current++;
+    scanner->current++;
     return true;
 }
 
-static char peek() {
-    return *scanner.current;
+static char peek(CloxScanner * const scanner) {
+    if (*scanner->current == '\0') {
+        refill(scanner, 1);
+    }
+
+    return *scanner->current;
 }
 
-static char peek_next() {
-    return is_at_end() ? '\0' : scanner.current[1];
+static char peek_next(CloxScanner * const scanner) {
+    if (is_at_end(scanner)) {
+        return '\0';
+    }
+
+    if (scanner->current[1] == '\0') {
+        refill(scanner, 2);
+    }
+
+    return scanner->current[1];
 }
 
-static void skip_whitespace() {
+static void skip_whitespace(CloxScanner * const scanner) {
     for (;;) {
-        char next = peek();
+        // Nothing before this point is part of a token, so a stream window
+        // refill doesn't have to keep it.
+        scanner->start = scanner->current;
+
+        char next = peek(scanner);
         switch (next) {
             case ' ':
             case '\t':
             case '\r':
-                advance();
-                break;
-
             case '\n':
-                scanner.line++;
-                advance();
+                // Most runs are a single space or newline, which isn't worth
+                // a call into the kernels.
+                scanner->line += next == '\n';
+                advance(scanner);
+
+                if (has_class(*scanner->current, CLOX_CHAR_BLANK)) {
+                    scanner->current = scanner->kernels->whitespace(scanner->current, &scanner->line);
+                }
+
                 break;
 
             case '/':
-                if (peek_next() == '/') {
-                    while (peek() != '\n' && !is_at_end()) {
-                        advance();
-                    }
+                if (peek_next(scanner) == '/') {
+                    // The comment ends before its newline, which is then
+                    // skipped as whitespace.
+                    do {
+                        scanner->current = scanner->kernels->comment(scanner->current);
+                        scanner->start = scanner->current;
+                    } while (*scanner->current == '\0' && refill(scanner, 1));
                 } else {
                     return;
                 }
@@ -78,217 +161,179 @@ static void skip_whitespace() {
     }
 }
 
-static CloxToken make_token(CloxTokenType type) {
+// Copies the current lexeme out of the stream window, which the next refill
+// may overwrite, into the oldest of the scanner's lexeme buffers.
+static const char * keep_lexeme(CloxScanner * const scanner, int length) {
+    CloxScannerLexeme * const lexeme = &scanner->lexemes[scanner->next_lexeme];
+    scanner->next_lexeme = (scanner->next_lexeme + 1) % CLOX_SCANNER_LEXEMES;
+
+    if (lexeme->capacity < length + 1) {
+        int capacity = lexeme->capacity;
+
+        while (capacity < length + 1) {
+            capacity = CLOX_GROW_CAPACITY(capacity);
+        }
+
+        lexeme->text = CLOX_GROW_ARRAY(CLOX_ALLOC_IO, lexeme->text, char, lexeme->capacity, capacity);
+        lexeme->capacity = capacity;
+    }
+
+    memcpy(lexeme->text, scanner->start, (size_t)length);
+    lexeme->text[length] = '\0';
+    return lexeme->text;
+}
+
+static CloxToken make_token(CloxScanner * const scanner, CloxTokenType type) {
     CloxToken token = {
         type,
-        scanner.start,
-        (int)(scanner.current - scanner.start),
-        scanner.line
+        scanner->start,
+        (int)(scanner->current - scanner->start),
+        scanner->line
     };
+
+    if (scanner->fd >= 0) {
+        token.start = keep_lexeme(scanner, token.length);
+    }
+
     return token;
 }
 
-static CloxToken token_error(const char * const message) {
+static CloxToken token_error(const CloxScanner * const scanner, const char * const message) {
     CloxToken token = {
         TOKEN_ERROR,
         message,
         (int)strlen(message),
-        scanner.line
+        scanner->line
     };
     return token;
 }
 
-static CloxTokenType check_keyword(int start, int length, char *rest, CloxTokenType type) {
-    if (scanner.current - scanner.start == start + length && memcmp(scanner.start + start, rest, length) == 0) {
-        return type;
+// Most identifiers and numbers are only a few characters long, and finishing
+// those one at a time beats the setup of a vector loop.
+#define SHORT_RUN 4
+
+// Skips the characters from the current one on that `belongs` holds for: the
+// first SHORT_RUN one at a time, the rest with `skip`, refilling the stream
+// window whenever the run reaches its end.
+static void skip_run(CloxScanner * const scanner, bool (*belongs)(char), const char * (*skip)(const char *)) {
+    for (int i = 0; i < SHORT_RUN; i++) {
+        if (!belongs(peek(scanner))) {
+            return;
+        }
+
+        scanner->current++;
     }
 
-    return TOKEN_IDENTIFIER;
+    while (belongs(peek(scanner))) {
+        scanner->current = skip(scanner->current + 1);
+    }
 }
 
-static CloxTokenType identifier_type() {
-    switch (scanner.start[0]) {
-        case 'a':
-            return check_keyword(1, 2, "nd", TOKEN_AND);
-
-        case 'c':
-            return check_keyword(1, 4, "lass", TOKEN_CLASS);
-
-        case 'e':
-            return check_keyword(1, 3, "lse", TOKEN_ELSE);
-
-        case 'f':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'a':
-                        return check_keyword(2, 3, "lse", TOKEN_FALSE);
-
-                    case 'o':
-                        return check_keyword(2, 1, "r", TOKEN_FOR);
-
-                    case 'u':
-                        return check_keyword(2, 1, "n", TOKEN_FUN);
-                }
-            }
-
-            break;
-
-        case 'i':
-            return check_keyword(1, 1, "f", TOKEN_IF);
-
-        case 'n':
-            return check_keyword(1, 2, "il", TOKEN_NIL);
-
-        case 'o':
-            return check_keyword(1, 1, "r", TOKEN_OR);
-
-        case 'p':
-            return check_keyword(1, 4, "rint", TOKEN_PRINT);
-
-        case 'r':
-            return check_keyword(1, 5, "eturn", TOKEN_RETURN);
-
-        case 's':
-            return check_keyword(1, 4, "uper", TOKEN_SUPER);
-
-        case 't':
-            if (scanner.current - scanner.start > 1) {
-                switch (scanner.start[1]) {
-                    case 'h':
-                        return check_keyword(2, 2, "is", TOKEN_THIS);
-
-                    case 'r':
-                        return check_keyword(2, 2, "ue", TOKEN_TRUE);
-                }
-            }
-
-            break;
+static CloxToken identifier(CloxScanner * const scanner) {
+    skip_run(scanner, isalnumscore, scanner->kernels->identifier);
+    int length = (int)(scanner->current - scanner->start);
+    return make_token(scanner, clox_keyword_type(scanner->start, length));
+}
 
-        case 'v':
-            return check_keyword(1, 2, "ar", TOKEN_VAR);
+static CloxToken number(CloxScanner * const scanner) {
+    skip_run(scanner, isdigit_ascii, scanner->kernels->digits);
 
-        case 'w':
-            return check_keyword(1, 4, "hile", TOKEN_WHILE);
+    if (peek(scanner) == '.' && isdigit_ascii(peek_next(scanner))) {
+        advance(scanner);
+        skip_run(scanner, isdigit_ascii, scanner->kernels->digits);
     }
 
-    return TOKEN_IDENTIFIER;
+    return make_token(scanner, TOKEN_NUMBER);
 }
 
-static CloxToken identifier() {
-    while (isalnumscore(peek())) {
-        advance();
+static CloxToken string(CloxScanner * const scanner) {
+    do {
+        scanner->current = scanner->kernels->string(scanner->current, &scanner->line);
+    } while (*scanner->current == '\0' && refill(scanner, 1));
+
+    if (is_at_end(scanner)) {
+        return token_error(scanner, "Unterminated string.");
     }
 
-    return make_token(identifier_type());
+    advance(scanner);
+    return make_token(scanner, TOKEN_STRING);
 }
 
-static CloxToken number() {
-    while (isdigit(peek())) {
-        advance();
+void clox_scanner_init(CloxScanner * const scanner, const char * const source) {
+    scanner->start = source;
+    scanner->current = source;
+    scanner->line = 1;
+    scanner->kernels = clox_scan_kernels();
+
+    scanner->fd = -1;
+    scanner->eof = true;
+    scanner->window = NULL;
+    scanner->window_count = 0;
+    scanner->window_capacity = 0;
+
+    for (int i = 0; i < CLOX_SCANNER_LEXEMES; i++) {
+        scanner->lexemes[i].text = NULL;
+        scanner->lexemes[i].capacity = 0;
     }
 
-    if (peek() == '.' && isdigit(peek_next())) {
-        advance();
+    scanner->next_lexeme = 0;
+}
 
-        while (isdigit(peek())) {
-            advance();
-        }
-    }
+// Scans source read incrementally from `fd`, which the scanner doesn't close.
+void clox_scanner_init_stream(CloxScanner * const scanner, int fd) {
+    char * const window = CLOX_GROW_ARRAY(CLOX_ALLOC_IO, NULL, char, 0, STREAM_WINDOW_SIZE);
+    window[0] = '\0';
 
-    return make_token(TOKEN_NUMBER);
+    clox_scanner_init(scanner, window);
+    scanner->fd = fd;
+    scanner->eof = false;
+    scanner->window = window;
+    scanner->window_capacity = STREAM_WINDOW_SIZE;
 }
 
-static CloxToken string() {
-    while (peek() != '"' && !is_at_end()) {
-        if (peek() == '\n') {
-            scanner.line++;
-        }
-
-        advance();
-    }
+void clox_scanner_free(CloxScanner * const scanner) {
+    CLOX_FREE_ARRAY(CLOX_ALLOC_IO, char, scanner->window, scanner->window_capacity);
 
-    if (is_at_end()) {
-        return token_error("Unterminated string.");
+    for (int i = 0; i < CLOX_SCANNER_LEXEMES; i++) {
+        CLOX_FREE_ARRAY(CLOX_ALLOC_IO, char, scanner->lexemes[i].text, scanner->lexemes[i].capacity);
     }
 
-    advance();
-    return make_token(TOKEN_STRING);
+    clox_scanner_init(scanner, "");
 }
 
-void clox_scanner_init(const char * const source) {
-    scanner.start = source;
-    scanner.current = source;
-    scanner.line = 1;
-}
-
-CloxToken clox_scanner_scan_token() {
-    skip_whitespace();
+CloxToken clox_scanner_scan_token(CloxScanner * const scanner) {
+    skip_whitespace(scanner);
 
-    scanner.start = scanner.current;
+    scanner->start = scanner->current;
 
-    if (is_at_end()) {
-        return make_token(TOKEN_EOF);
+    if (is_at_end(scanner)) {
+        return make_token(scanner, TOKEN_EOF);
     }
 
-    char next = advance();
+    char next = advance(scanner);
+    uint8_t classes = clox_char_class[(uint8_t)next];
 
-    if (isalscore(next)) {
-        return identifier();
+    if (classes & CLOX_CHAR_ALPHA) {
+        return identifier(scanner);
     }
 
-    if (isdigit(next)) {
-        return number();
+    if (classes & CLOX_CHAR_DIGIT) {
+        return number(scanner);
     }
 
-    switch (next) {
-        case '(':
-            return make_token(TOKEN_LEFT_PAREN);
-
-        case ')':
-            return make_token(TOKEN_RIGHT_PAREN);
-
-        case '{':
-            return make_token(TOKEN_LEFT_BRACE);
-
-        case '}':
-            return make_token(TOKEN_RIGHT_BRACE);
-
-        case ';':
-            return make_token(TOKEN_SEMICOLON);
-
-        case ',':
-            return make_token(TOKEN_COMMA);
-
-        case '.':
-            return make_token(TOKEN_DOT);
-
-        case '-':
-            return make_token(TOKEN_MINUS);
-
-        case '+':
-            return make_token(TOKEN_PLUS);
-
-        case '/':
-            return make_token(TOKEN_SLASH);
-
-        case '*':
-            return make_token(TOKEN_STAR);
-
-        case '!':
-            return make_token(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
-
-        case '=':
-            return make_token(match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
+    if (next == '"') {
+        return string(scanner);
+    }
 
-        case '<':
-            return make_token(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+    CloxTokenType type = (CloxTokenType)clox_char_token[(uint8_t)next];
 
-        case '>':
-            return make_token(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+    if (type == TOKEN_ERROR) {
+        return token_error(scanner, "Unexpected character.");
+    }
 
-        case '"':
-            return string();
+    if ((classes & CLOX_CHAR_EQUAL_SUFFIX) && match(scanner, '=')) {
+        type = (CloxTokenType)(type + 1);
     }
 
-    return token_error("Unexpected character.");
+    return make_token(scanner, type);
 }
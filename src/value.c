@@ -1,30 +1,159 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "memory.h"
 #include "value.h"
 
+// Slots hold the array index plus one, so that zero can mark an empty slot.
+#define INDEX_EMPTY 0
+#define INDEX_MAX_LOAD(capacity) ((capacity) / 4 * 3)
+
+static uint32_t value_hash(CloxValue value) {
+    uint64_t bits = value;
+    bits ^= bits >> 33;
+    bits *= UINT64_C(0xff51afd7ed558ccd);
+    bits ^= bits >> 33;
+    return (uint32_t)bits;
+}
+
+int clox_value_format(CloxValue value, CloxNumberFormat format, char * const buffer) {
+    if (!CLOX_IS_NUMBER(value)) {
+        const char * const name = CLOX_IS_NIL(value) ? "nil" : CLOX_AS_BOOL(value) ? "true" : "false";
+        size_t length = strlen(name);
+        memcpy(buffer, name, length + 1);
+        return (int)length;
+    }
+
+    double number = CLOX_AS_NUMBER(value);
+
+    if (format == CLOX_NUMBER_FORMAT_PRINTF) {
+        return snprintf(buffer, CLOX_VALUE_FORMAT_MAX, "%g", number);
+    }
+
+    return clox_number_format(number, buffer);
+}
+
 void clox_value_print(CloxValue value) {
-    printf("%g", value);
+    char buffer[CLOX_VALUE_FORMAT_MAX];
+    clox_value_format(value, CLOX_NUMBER_FORMAT_SHORTEST, buffer);
+    fputs(buffer, stdout);
 }
 
 void clox_valuearray_init(CloxValueArray * const array) {
     array->capacity = 0;
     array->count = 0;
     array->values = NULL;
+    array->arena = NULL;
 }
 
 void clox_valuearray_write(CloxValueArray * const array, CloxValue value) {
     if (array->capacity < array->count + 1) {
         int oldCapacity = array->capacity;
         array->capacity = CLOX_GROW_CAPACITY(array->capacity);
-        array->values = CLOX_GROW_ARRAY(array->values, CloxValue, oldCapacity, array->capacity);
+        array->values = CLOX_ARENA_GROW_ARRAY(array->arena, CLOX_ALLOC_CONSTANTS, array->values, CloxValue, oldCapacity, array->capacity);
     }
 
     array->values[array->count++] = value;
 }
 
 void clox_valuearray_free(CloxValueArray * const array) {
-    CLOX_FREE_ARRAY(CloxValue, array->values, array->capacity);
+    CLOX_ARENA_FREE_ARRAY(array->arena, CLOX_ALLOC_CONSTANTS, CloxValue, array->values, array->capacity);
     clox_valuearray_init(array);
 }
+
+void clox_valueindex_init(CloxValueIndex * const index) {
+    index->capacity = 0;
+    index->count = 0;
+    index->slots = NULL;
+}
+
+int clox_valueindex_find(const CloxValueIndex * const index, const CloxValueArray * const array, CloxValue value) {
+    if (index->count == 0) {
+        return -1;
+    }
+
+    uint32_t mask = (uint32_t)index->capacity - 1;
+
+    for (uint32_t i = value_hash(value) & mask;; i = (i + 1) & mask) {
+        int slot = index->slots[i];
+
+        if (slot == INDEX_EMPTY) {
+            return -1;
+        }
+
+        if (array->values[slot - 1] == value) {
+            return slot - 1;
+        }
+    }
+}
+
+static void index_place(CloxValueIndex * const index, const CloxValueArray * const array, int slot) {
+    uint32_t mask = (uint32_t)index->capacity - 1;
+    uint32_t i = value_hash(array->values[slot]) & mask;
+
+    while (index->slots[i] != INDEX_EMPTY) {
+        i = (i + 1) & mask;
+    }
+
+    index->slots[i] = slot + 1;
+}
+
+void clox_valueindex_insert(CloxValueIndex * const index, const CloxValueArray * const array, int slot) {
+    if (index->count + 1 > INDEX_MAX_LOAD(index->capacity)) {
+        int oldCapacity = index->capacity;
+        int *oldSlots = index->slots;
+
+        index->capacity = CLOX_GROW_CAPACITY(index->capacity);
+        index->slots = CLOX_GROW_ARRAY(CLOX_ALLOC_CONSTANT_INDEX, NULL, int, 0, index->capacity);
+        memset(index->slots, INDEX_EMPTY, sizeof(int) * index->capacity);
+
+        for (int i = 0; i < oldCapacity; i++) {
+            if (oldSlots[i] != INDEX_EMPTY) {
+                index_place(index, array, oldSlots[i] - 1);
+            }
+        }
+
+        CLOX_FREE_ARRAY(CLOX_ALLOC_CONSTANT_INDEX, int, oldSlots, oldCapacity);
+    }
+
+    index_place(index, array, slot);
+    index->count++;
+}
+
+void clox_valueindex_remove(CloxValueIndex * const index, const CloxValueArray * const array, int slot) {
+    if (index->count == 0) {
+        return;
+    }
+
+    uint32_t mask = (uint32_t)index->capacity - 1;
+    uint32_t hole = value_hash(array->values[slot]) & mask;
+
+    while (index->slots[hole] != slot + 1) {
+        if (index->slots[hole] == INDEX_EMPTY) {
+            return;
+        }
+
+        hole = (hole + 1) & mask;
+    }
+
+    // Shift later entries of the probe sequence back into the hole, so that
+    // lookups never stop early at an empty slot they used to probe past.
+    for (uint32_t i = (hole + 1) & mask; index->slots[i] != INDEX_EMPTY; i = (i + 1) & mask) {
+        uint32_t home = value_hash(array->values[index->slots[i] - 1]) & mask;
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index->slots[hole] = index->slots[i];
+            hole = i;
+        }
+    }
+
+    index->slots[hole] = INDEX_EMPTY;
+    index->count--;
+}
+
+void clox_valueindex_free(CloxValueIndex * const index) {
+    CLOX_FREE_ARRAY(CLOX_ALLOC_CONSTANT_INDEX, int, index->slots, index->capacity);
+    clox_valueindex_init(index);
+}
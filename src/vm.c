@@ -7,88 +7,187 @@
 #include "config.h"
 #include "value.h"
 #include "debug.h"
+#include "jit.h"
+#include "lane_kernels.h"
+#include "memory.h"
+#include "profile.h"
 
-static CloxVM vm;
-static const void * const stack_end = vm.stack + sizeof(vm.stack) / sizeof(vm.stack[0]);
+// CLOX_SWITCH_DISPATCH overrides the dispatch option for one build of this
+// file, which the clox-bench-switch benchmark uses to compare the two.
+#if defined(CLOX_THREADED_DISPATCH) && defined(__GNUC__) && !defined(CLOX_SWITCH_DISPATCH)
+#define CLOX_VM_THREADED
+#endif
 
-static CloxInterpretResult run() {
+#ifdef CLOX_DEBUG_TRACE_EXECUTION
+static void trace_instruction(const CloxVM * const vm, const uint8_t * const ip, const CloxValue * const stack_top) {
+    printf("   (S)    ");
+    for (const CloxValue *slot = vm->stack; slot < stack_top; slot++) {
+        printf("[ ");
+        clox_value_print(*slot);
+        printf(" ]");
+    }
+    printf("\n");
+    clox_chunk_disassemble_instruction(vm->chunk, (int)(ip - vm->chunk->code));
+}
+#define TRACE_INSTRUCTION() trace_instruction(vm, ip, stack_top)
+#else
+#define TRACE_INSTRUCTION() ((void)0)
+#endif
 
-#define READ_BYTE() (*vm.ip++)
-#define READ_CONSTANT() (vm.chunk->constants.values[READ_BYTE()])
-#define BINARY_OP(op) do { \
-        CloxValue b = clox_vm_stack_pop(); \
-        CloxValue a = clox_vm_stack_pop(); \
-        clox_vm_stack_push(a op b); \
-    } while (false)
+// Reports a type error in the instruction that ends just before `ip` and
+// abandons the run.
+static CloxInterpretResult runtime_error(CloxVM * const vm, const uint8_t * const ip, const char * const message) {
+    int line = clox_chunk_get_line(vm->chunk, (int)(ip - vm->chunk->code) - 1);
+    fprintf(stderr, "%s\n[line %d] in script\n", message, line);
+    vm->stack_top = vm->stack;
+    return INTERPRET_RUNTIME_ERROR;
+}
 
-    for (;;) {
-#ifdef CLOX_DEBUG_TRACE_EXECUTION
-        printf("   (S)    ");
-        for (CloxValue *slot = vm.stack; slot < vm.stack_top; slot++) {
-            printf("[ ");
-            clox_value_print(*slot);
-            printf(" ]");
-        }
-        printf("\n");
-        clox_chunk_disassemble_instruction(vm.chunk, (int)(vm.ip - vm.chunk->code));
+static void flush_output(CloxVMOutput * const output) {
+    if (output->count > 0) {
+        fwrite(output->buffer, 1, output->count, output->stream);
+        output->count = 0;
+    }
+}
+
+// Appends `value` and a newline to the output buffer, making room first.
+static void write_result(CloxVM * const vm, CloxValue value) {
+    CloxVMOutput * const output = &vm->output;
+
+    if (CLOX_VM_OUTPUT_SIZE - output->count < CLOX_VALUE_FORMAT_MAX + 1) {
+        flush_output(output);
+    }
+
+    char * const text = output->buffer + output->count;
+    int length = clox_value_format(value, output->number_format, text);
+    text[length] = '\n';
+    output->count += (size_t)length + 1;
+}
+
+#ifdef CLOX_VM_THREADED
+// Labels-as-values are a GNU extension, which -Wpedantic complains about.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
 #endif
 
-        uint8_t instruction;
-        switch (instruction = READ_BYTE()) {
-            case OP_CONSTANT:
-                clox_vm_stack_push(READ_CONSTANT());
-                break;
-
-            case OP_CONSTANT_LONG: {
-                uint8_t high = READ_BYTE() << 8;
-                uint8_t low = READ_BYTE();
-                size_t idx = high | low;
-                CloxValue value = vm.chunk->constants.values[idx];
-                clox_vm_stack_push(value);
-                break;
-            }
+// run() is the dispatch loop; run_profiled() is the same loop built with
+// PROFILE_INSTRUCTION() reporting every dispatch to the VM's profile, so that
+// profiling costs nothing when it is off.
+#define RUN run
+#define PROFILE_INSTRUCTION() ((void)0)
+#include "vm_run.h"
+#undef PROFILE_INSTRUCTION
+#undef RUN
 
-            case OP_ADD:
-                BINARY_OP(+);
-                break;
+#define RUN run_profiled
+#define PROFILE_INSTRUCTION() clox_profile_tick(vm->profile, (int)(ip - vm->chunk->code))
+#include "vm_run.h"
+#undef PROFILE_INSTRUCTION
+#undef RUN
 
-            case OP_SUBTRACT:
-                BINARY_OP(-);
-                break;
+#ifdef CLOX_VM_THREADED
+#pragma GCC diagnostic pop
+#endif
 
-            case OP_MULTIPLY:
-                BINARY_OP(*);
-                break;
+static void reset_stack(CloxVM * const vm) {
+    vm->stack_top = vm->stack;
+}
 
-            case OP_DIVIDE:
-                BINARY_OP(/);
-                break;
+// Makes room for at least `needed` more values on top of the stack, doubling
+// its size as often as it takes without going past the configured maximum.
+// This is the only place the stack moves, so pointers into it must be rebased
+// afterwards.
+static bool reserve_stack(CloxVM * const vm, size_t needed) {
+    size_t used = (size_t)(vm->stack_top - vm->stack);
+    size_t capacity = (size_t)(vm->stack_end - vm->stack);
 
-            case OP_NEGATE:
-                clox_vm_stack_push(-clox_vm_stack_pop());
-                break;
+    if (used > vm->stack_max || needed > vm->stack_max - used) {
+        return false;
+    }
 
-            case OP_RETURN:
-                clox_value_print(clox_vm_stack_pop());
-                printf("\n");
-                return INTERPRET_OK;
-        }
+    if (needed <= capacity - used) {
+        return true;
     }
 
-#undef BINARY_OP
-#undef READ_CONSTANT
-#undef READ_BYTE
+    size_t newCapacity = capacity;
+
+    while (newCapacity - used < needed) {
+        newCapacity *= 2;
+    }
+
+    if (newCapacity > vm->stack_max) {
+        newCapacity = vm->stack_max;
+    }
+
+    vm->stack = CLOX_GROW_ARRAY(CLOX_ALLOC_VM, vm->stack, CloxValue, capacity, newCapacity);
+    vm->stack_top = vm->stack + used;
+    vm->stack_end = vm->stack + newCapacity;
+    return true;
+}
+
+CloxVM * clox_vm_new() {
+    CloxVM * const vm = (CloxVM *)CLOX_REALLOCATE(CLOX_ALLOC_VM, NULL, 0, sizeof(CloxVM));
+
+    vm->chunk = NULL;
+    vm->ip = NULL;
+    vm->stack = CLOX_GROW_ARRAY(CLOX_ALLOC_VM, NULL, CloxValue, 0, CLOX_VM_STACK_INITIAL);
+    vm->stack_end = vm->stack + CLOX_VM_STACK_INITIAL;
+    vm->stack_max = CLOX_VM_STACK_MAX_DEFAULT;
+    vm->profile = NULL;
+    vm->output.stream = stdout;
+    vm->output.buffer = CLOX_GROW_ARRAY(CLOX_ALLOC_VM, NULL, char, 0, CLOX_VM_OUTPUT_SIZE);
+    vm->output.count = 0;
+    vm->output.batching = false;
+    vm->output.number_format = CLOX_NUMBER_FORMAT_SHORTEST;
+    vm->jit_hot_runs = 0;
+    vm->inputs = NULL;
+    vm->result = NULL;
+    vm->lanes = NULL;
+    vm->lanes_capacity = 0;
+    reset_stack(vm);
+
+    return vm;
 }
 
-static void reset_stack() {
-    vm.stack_top = vm.stack;
+void clox_vm_set_stack_max(CloxVM * const vm, size_t slots) {
+    vm->stack_max = slots;
 }
 
-void clox_vm_init() {
-    reset_stack();
+// Runs every chunk from now on with the profiling loop, recording into
+// `profile`, which the caller keeps ownership of. NULL turns profiling off.
+void clox_vm_set_profile(CloxVM * const vm, CloxProfile * const profile) {
+    vm->profile = profile;
 }
 
-CloxInterpretResult clox_vm_interpret(const char * const source) {
+void clox_vm_set_number_format(CloxVM * const vm, CloxNumberFormat format) {
+    vm->output.number_format = format;
+}
+
+// Batching holds results across runs until the buffer fills up, which suits
+// evaluating many short programs in a row; the caller then has to call
+// clox_vm_flush() to see the rest. Turning it off flushes.
+void clox_vm_set_output_batching(CloxVM * const vm, bool batching) {
+    vm->output.batching = batching;
+
+    if (!batching) {
+        flush_output(&vm->output);
+    }
+}
+
+// Compiles each chunk that only deals in numbers to native code on its
+// `hot_runs`th run (1 being its first), and runs that from then on. 0 turns
+// the JIT off; so does a profile, which needs every instruction to go through
+// run_profiled(). Does nothing where clox_jit_available() is false.
+void clox_vm_set_jit(CloxVM * const vm, int hot_runs) {
+    vm->jit_hot_runs = clox_jit_available() && hot_runs > 0 ? hot_runs : 0;
+}
+
+// Writes out the buffered results. The stream itself isn't flushed.
+void clox_vm_flush(CloxVM * const vm) {
+    flush_output(&vm->output);
+}
+
+CloxInterpretResult clox_vm_interpret(CloxVM * const vm, const char * const source) {
     CloxChunk chunk;
     clox_chunk_init(&chunk);
 
@@ -97,28 +196,280 @@ CloxInterpretResult clox_vm_interpret(const char * const source) {
         return INTERPRET_COMPILE_ERROR;
     }
 
-    vm.chunk = &chunk;
-    vm.ip = vm.chunk->code;
-
-    CloxInterpretResult result = run();
+    CloxInterpretResult result = clox_vm_interpret_chunk(vm, &chunk);
 
     clox_chunk_free(&chunk);
     return result;
 }
 
-void clox_vm_stack_push(CloxValue value) {
-    if (vm.stack_top == stack_end) {
-        fprintf(stderr, " /!\\ STACK OVERFLOW /!\\\n");
-        abort();
+static CloxInterpretResult stack_overflow(const CloxVM * const vm, const CloxChunk * const chunk) {
+    fprintf(
+        stderr,
+        "Stack overflow: expression needs %d stack slots, the limit is %zu.\n",
+        chunk->max_stack,
+        vm->stack_max);
+    return INTERPRET_RUNTIME_ERROR;
+}
+
+// Counts a run of the chunk towards its compilation and says whether there
+// is native code to run it with.
+static bool use_jit(CloxVM * const vm, CloxChunk * const chunk) {
+    if (vm->jit_hot_runs == 0 || vm->profile != NULL || chunk->jit_runs < 0) {
+        return false;
+    }
+
+    if (chunk->jit == NULL && ++chunk->jit_runs >= vm->jit_hot_runs) {
+        chunk->jit = clox_jit_compile(chunk, chunk->jit_spare);
+        chunk->jit_spare = NULL;
+
+        if (chunk->jit == NULL) {
+            chunk->jit_runs = -1;
+        }
+    }
+
+    return chunk->jit != NULL;
+}
+
+static CloxInterpretResult execute(CloxVM * const vm, CloxChunk * const chunk) {
+    if (!reserve_stack(vm, (size_t)chunk->max_stack)) {
+        return stack_overflow(vm, chunk);
+    }
+
+    vm->chunk = chunk;
+    vm->ip = vm->chunk->code;
+
+    if (use_jit(vm, chunk)) {
+        // As OP_RETURN does.
+        CloxValue value = CLOX_NUMBER_VAL(clox_jit_run(chunk->jit, vm->stack_top, chunk->constants.values, vm->inputs));
+
+        if (vm->result != NULL) {
+            *vm->result = value;
+        } else {
+            write_result(vm, value);
+        }
+
+        return INTERPRET_OK;
+    }
+
+    if (vm->profile == NULL) {
+        return run(vm);
+    }
+
+    clox_profile_begin_run(vm->profile, chunk);
+    CloxInterpretResult result = run_profiled(vm);
+    clox_profile_end_run(vm->profile, chunk);
+
+    return result;
+}
+
+// Runs an already compiled chunk and prints its result. The chunk's max_stack
+// must be accurate, as it is what keeps the unchecked stack accesses in run()
+// in bounds.
+CloxInterpretResult clox_vm_interpret_chunk(CloxVM * const vm, CloxChunk * const chunk) {
+    if (chunk->input_count > 0) {
+        fprintf(stderr, "Expression reads %d inputs, which only clox_vm_evaluate() can supply.\n", chunk->input_count);
+        return INTERPRET_RUNTIME_ERROR;
+    }
+
+    CloxInterpretResult result = execute(vm, chunk);
+
+    if (!vm->output.batching) {
+        flush_output(&vm->output);
+    }
+
+    return result;
+}
+
+// Runs a chunk with `inputs` holding a value for each of its input slots, and
+// stores the result in `result` rather than printing it. A NaN result is the
+// canonical one, as clox_vm_run_lanes() gives.
+CloxInterpretResult clox_vm_evaluate(CloxVM * const vm, CloxChunk * const chunk, const double * const inputs, CloxValue * const result) {
+    vm->inputs = inputs;
+    vm->result = result;
+
+    CloxInterpretResult status = execute(vm, chunk);
+
+    if (status == INTERPRET_OK && CLOX_IS_NUMBER(*result)) {
+        *result = clox_value_canonical(CLOX_AS_NUMBER(*result));
+    }
+
+    vm->inputs = NULL;
+    vm->result = NULL;
+    return status;
+}
+
+// Lanes per block when the stack is shallow enough; deeper stacks get fewer,
+// so that all of a block's rows stay within LANE_SCRATCH_BYTES.
+#define LANE_BLOCK 512
+#define LANE_BLOCK_MIN 16
+#define LANE_SCRATCH_BYTES (256 * 1024)
+
+// The lane by lane fallback for chunks that use other values. Since inputs
+// are always numbers, those either fail the same way in every lane or
+// return something that isn't a number.
+static CloxInterpretResult run_lanes_scalar(
+        CloxVM * const vm,
+        CloxChunk * const chunk,
+        const double * const * const inputs,
+        size_t count,
+        double * const results) {
+    double values[CLOX_CHUNK_MAX_INPUTS];
+
+    for (size_t lane = 0; lane < count; lane++) {
+        for (int slot = 0; slot < chunk->input_count; slot++) {
+            values[slot] = inputs[slot][lane];
+        }
+
+        CloxValue result;
+        CloxInterpretResult status = clox_vm_evaluate(vm, chunk, values, &result);
+
+        if (status != INTERPRET_OK) {
+            return status;
+        }
+
+        if (!CLOX_IS_NUMBER(result)) {
+            fprintf(stderr, "Expression evaluates to a value that isn't a number.\n");
+            return INTERPRET_RUNTIME_ERROR;
+        }
+
+        results[lane] = CLOX_AS_NUMBER(result);
+    }
+
+    return INTERPRET_OK;
+}
+
+// Evaluates a chunk over `count` lanes, reading input slot i of lane j from
+// inputs[i][j] and storing the result of lane j in results[j]. The code runs
+// over a block of lanes at a time, with a row of doubles per stack slot and
+// each instruction dispatched once per block to a kernel that works through
+// the whole row with the widest vectors the CPU has (see lane_kernels.h).
+// Every lane gets exactly the bits clox_vm_evaluate() would give it. Runs
+// aren't profiled.
+CloxInterpretResult clox_vm_run_lanes(
+        CloxVM * const vm,
+        CloxChunk * const chunk,
+        const double * const * const inputs,
+        size_t count,
+        double * const results) {
+    if ((size_t)chunk->max_stack > vm->stack_max) {
+        return stack_overflow(vm, chunk);
+    }
+
+    if (!clox_chunk_numbers_only(chunk)) {
+        return run_lanes_scalar(vm, chunk, inputs, count, results);
+    }
+
+    const size_t depth = chunk->max_stack > 0 ? (size_t)chunk->max_stack : 1;
+    size_t block = LANE_SCRATCH_BYTES / sizeof(double) / depth;
+    block = block > LANE_BLOCK ? LANE_BLOCK : block < LANE_BLOCK_MIN ? LANE_BLOCK_MIN : block;
+
+    if (vm->lanes_capacity < depth * block) {
+        vm->lanes = CLOX_GROW_ARRAY(CLOX_ALLOC_VM, vm->lanes, double, vm->lanes_capacity, depth * block);
+        vm->lanes_capacity = depth * block;
+    }
+
+    const CloxLaneKernels * const kernels = clox_lane_kernels();
+    const CloxValue * const constants = chunk->constants.values;
+
+    for (size_t start = 0; start < count; start += block) {
+        const size_t lanes = count - start < block ? count - start : block;
+        const uint8_t *ip = chunk->code;
+        // The row above the top of the stack.
+        double *top = vm->lanes;
+        bool returned = false;
+
+        while (!returned) {
+            double * const last = top - block;
+
+            switch (*ip++) {
+                case OP_CONSTANT:
+                    kernels->fill(top, CLOX_AS_NUMBER(constants[*ip++]), lanes);
+                    top += block;
+                    break;
+
+                case OP_CONSTANT_LONG:
+                    kernels->fill(top, CLOX_AS_NUMBER(constants[(ip[0] << 8) | ip[1]]), lanes);
+                    ip += 2;
+                    top += block;
+                    break;
+
+                case OP_INPUT:
+                    kernels->canonical(top, inputs[*ip++] + start, lanes);
+                    top += block;
+                    break;
+
+                case OP_ADD:
+                    kernels->add(last - block, last - block, last, lanes);
+                    top = last;
+                    break;
+
+                case OP_SUBTRACT:
+                    kernels->subtract(last - block, last - block, last, lanes);
+                    top = last;
+                    break;
+
+                case OP_MULTIPLY:
+                    kernels->multiply(last - block, last - block, last, lanes);
+                    top = last;
+                    break;
+
+                case OP_DIVIDE:
+                    kernels->divide(last - block, last - block, last, lanes);
+                    top = last;
+                    break;
+
+                case OP_ADD_CONSTANT:
+                    kernels->add_constant(last, last, CLOX_AS_NUMBER(constants[*ip++]), lanes);
+                    break;
+
+                case OP_SUBTRACT_CONSTANT:
+                    kernels->subtract_constant(last, last, CLOX_AS_NUMBER(constants[*ip++]), lanes);
+                    break;
+
+                case OP_MULTIPLY_CONSTANT:
+                    kernels->multiply_constant(last, last, CLOX_AS_NUMBER(constants[*ip++]), lanes);
+                    break;
+
+                case OP_DIVIDE_CONSTANT:
+                    kernels->divide_constant(last, last, CLOX_AS_NUMBER(constants[*ip++]), lanes);
+                    break;
+
+                case OP_NEGATE:
+                    kernels->negate(last, last, lanes);
+                    break;
+
+                case OP_RETURN:
+                    kernels->canonical(results + start, last, lanes);
+                    returned = true;
+                    break;
+
+                default:
+                    // clox_chunk_numbers_only() has ruled everything else out.
+                    return INTERPRET_RUNTIME_ERROR;
+            }
+        }
     }
 
-    *vm.stack_top++ = value;
+    return INTERPRET_OK;
 }
 
-CloxValue clox_vm_stack_pop() {
-    return *(--vm.stack_top);
+bool clox_vm_stack_push(CloxVM * const vm, CloxValue value) {
+    if (vm->stack_top == vm->stack_end && !reserve_stack(vm, 1)) {
+        return false;
+    }
+
+    *vm->stack_top++ = value;
+    return true;
 }
 
-void clox_vm_free() {
+CloxValue clox_vm_stack_pop(CloxVM * const vm) {
+    return *(--vm->stack_top);
+}
 
+void clox_vm_free(CloxVM * const vm) {
+    flush_output(&vm->output);
+    CLOX_FREE_ARRAY(CLOX_ALLOC_VM, double, vm->lanes, vm->lanes_capacity);
+    CLOX_FREE_ARRAY(CLOX_ALLOC_VM, char, vm->output.buffer, CLOX_VM_OUTPUT_SIZE);
+    CLOX_FREE_ARRAY(CLOX_ALLOC_VM, CloxValue, vm->stack, vm->stack_end - vm->stack);
+    CLOX_REALLOCATE(CLOX_ALLOC_VM, vm, sizeof(CloxVM), 0);
 }
@@ -0,0 +1,174 @@
+// The VM's dispatch loop, included by vm.c once for each variant of it. The
+// includer defines RUN as the name of the function to generate and
+// PROFILE_INSTRUCTION() as the hook run before each instruction.
+
+// Runs the current chunk, which must have been checked to fit in the stack:
+// pushes and pops in here are unchecked, and the instruction and stack
+// pointers live in locals so they can stay in registers.
+static CloxInterpretResult RUN(CloxVM * const vm) {
+    uint8_t *ip = vm->ip;
+    CloxValue *stack_top = vm->stack_top;
+    const CloxValue * const constants = vm->chunk->constants.values;
+    const double * const inputs = vm->inputs;
+
+#define READ_BYTE() (*ip++)
+#define READ_CONSTANT() (constants[READ_BYTE()])
+#define PUSH(value) (*stack_top++ = (value))
+#define POP() (*--stack_top)
+#define NUMBER_OPERANDS(a, b) do { \
+        if (!CLOX_IS_NUMBER(a) || !CLOX_IS_NUMBER(b)) { \
+            return runtime_error(vm, ip, "Operands must be numbers."); \
+        } \
+    } while (false)
+#define BINARY_OP(op) do { \
+        CloxValue b = POP(); \
+        CloxValue a = POP(); \
+        NUMBER_OPERANDS(a, b); \
+        PUSH(CLOX_NUMBER_VAL(CLOX_AS_NUMBER(a) op CLOX_AS_NUMBER(b))); \
+    } while (false)
+#define BINARY_OP_CONSTANT(op) do { \
+        CloxValue b = READ_CONSTANT(); \
+        CloxValue a = POP(); \
+        NUMBER_OPERANDS(a, b); \
+        PUSH(CLOX_NUMBER_VAL(CLOX_AS_NUMBER(a) op CLOX_AS_NUMBER(b))); \
+    } while (false)
+
+#ifdef CLOX_VM_THREADED
+    // Every handler ends in its own indirect jump through this table instead of
+    // looping back to a single shared one, so the branch predictor gets to see
+    // which opcode tends to follow which.
+    static const void * const dispatch_table[] = {
+        [OP_CONSTANT] = &&do_OP_CONSTANT,
+        [OP_CONSTANT_LONG] = &&do_OP_CONSTANT_LONG,
+        [OP_NIL] = &&do_OP_NIL,
+        [OP_TRUE] = &&do_OP_TRUE,
+        [OP_FALSE] = &&do_OP_FALSE,
+        [OP_INPUT] = &&do_OP_INPUT,
+        [OP_ADD] = &&do_OP_ADD,
+        [OP_SUBTRACT] = &&do_OP_SUBTRACT,
+        [OP_MULTIPLY] = &&do_OP_MULTIPLY,
+        [OP_DIVIDE] = &&do_OP_DIVIDE,
+        [OP_ADD_CONSTANT] = &&do_OP_ADD_CONSTANT,
+        [OP_SUBTRACT_CONSTANT] = &&do_OP_SUBTRACT_CONSTANT,
+        [OP_MULTIPLY_CONSTANT] = &&do_OP_MULTIPLY_CONSTANT,
+        [OP_DIVIDE_CONSTANT] = &&do_OP_DIVIDE_CONSTANT,
+        [OP_NEGATE] = &&do_OP_NEGATE,
+        [OP_RETURN] = &&do_OP_RETURN
+    };
+
+#define INSTRUCTION(op) do_##op
+#define DISPATCH() do { \
+        TRACE_INSTRUCTION(); \
+        PROFILE_INSTRUCTION(); \
+        goto *dispatch_table[READ_BYTE()]; \
+    } while (false)
+#define NEXT() DISPATCH()
+
+    DISPATCH();
+#else
+#define INSTRUCTION(op) case op
+#define NEXT() break
+
+    for (;;) {
+        TRACE_INSTRUCTION();
+        PROFILE_INSTRUCTION();
+
+        switch (READ_BYTE()) {
+#endif
+            INSTRUCTION(OP_CONSTANT):
+                PUSH(READ_CONSTANT());
+                NEXT();
+
+            INSTRUCTION(OP_CONSTANT_LONG): {
+                size_t high = READ_BYTE();
+                size_t low = READ_BYTE();
+                size_t idx = (high << 8) | low;
+                PUSH(constants[idx]);
+                NEXT();
+            }
+
+            INSTRUCTION(OP_NIL):
+                PUSH(CLOX_NIL_VAL);
+                NEXT();
+
+            INSTRUCTION(OP_TRUE):
+                PUSH(CLOX_TRUE_VAL);
+                NEXT();
+
+            INSTRUCTION(OP_FALSE):
+                PUSH(CLOX_FALSE_VAL);
+                NEXT();
+
+            INSTRUCTION(OP_INPUT):
+                PUSH(clox_value_canonical(inputs[READ_BYTE()]));
+                NEXT();
+
+            INSTRUCTION(OP_ADD):
+                BINARY_OP(+);
+                NEXT();
+
+            INSTRUCTION(OP_SUBTRACT):
+                BINARY_OP(-);
+                NEXT();
+
+            INSTRUCTION(OP_MULTIPLY):
+                BINARY_OP(*);
+                NEXT();
+
+            INSTRUCTION(OP_DIVIDE):
+                BINARY_OP(/);
+                NEXT();
+
+            INSTRUCTION(OP_ADD_CONSTANT):
+                BINARY_OP_CONSTANT(+);
+                NEXT();
+
+            INSTRUCTION(OP_SUBTRACT_CONSTANT):
+                BINARY_OP_CONSTANT(-);
+                NEXT();
+
+            INSTRUCTION(OP_MULTIPLY_CONSTANT):
+                BINARY_OP_CONSTANT(*);
+                NEXT();
+
+            INSTRUCTION(OP_DIVIDE_CONSTANT):
+                BINARY_OP_CONSTANT(/);
+                NEXT();
+
+            INSTRUCTION(OP_NEGATE):
+                if (!CLOX_IS_NUMBER(stack_top[-1])) {
+                    return runtime_error(vm, ip, "Operand must be a number.");
+                }
+
+                stack_top[-1] = CLOX_NUMBER_VAL(-CLOX_AS_NUMBER(stack_top[-1]));
+                NEXT();
+
+            INSTRUCTION(OP_RETURN): {
+                CloxValue result = POP();
+                vm->ip = ip;
+                vm->stack_top = stack_top;
+
+                if (vm->result != NULL) {
+                    *vm->result = result;
+                } else {
+                    write_result(vm, result);
+                }
+
+                return INTERPRET_OK;
+            }
+#ifndef CLOX_VM_THREADED
+        }
+    }
+#endif
+
+#undef NEXT
+#undef DISPATCH
+#undef INSTRUCTION
+#undef BINARY_OP_CONSTANT
+#undef BINARY_OP
+#undef NUMBER_OPERANDS
+#undef POP
+#undef PUSH
+#undef READ_CONSTANT
+#undef READ_BYTE
+}
@@ -0,0 +1,197 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "jit.h"
+#include "value.h"
+#include "vm.h"
+
+// Runs random expressions over inputs through clox_vm_evaluate() on one VM
+// with the JIT and one without, and checks the results are bit for bit the
+// same. Half the expressions nest to the right, so they need more stack slots
+// than jit.c keeps in registers and spill the rest to memory. Expressions
+// without inputs fold down to a constant as they compile, which is why these
+// have inputs and don't go through `clox --batch`.
+
+#define PROGRAMS 400
+#define ROWS 24
+#define SOURCE_SIZE 8192
+
+// Stack slots jit.c keeps in xmm registers.
+#define REGISTER_SLOTS 14
+
+static const char * const input_names[] = { "a", "b", "c", "d" };
+
+#define INPUT_COUNT ((int)(sizeof(input_names) / sizeof(input_names[0])))
+
+static uint64_t state = 0x853c49e6748fea9bu;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void append(char * const source, const char * const text) {
+    if (strlen(source) + strlen(text) < SOURCE_SIZE) {
+        strcat(source, text);
+    }
+}
+
+static void operand(char * const source) {
+    char text[32];
+
+    if (next_random() % 3 != 0) {
+        append(source, input_names[next_random() % INPUT_COUNT]);
+    } else {
+        snprintf(text, sizeof(text), "%d.%d", (int)(next_random() % 1000), (int)(next_random() % 100));
+        append(source, text);
+    }
+}
+
+static const char * random_operator(void) {
+    static const char * const operators[] = { " + ", " - ", " * ", " / " };
+    return operators[next_random() % 4];
+}
+
+static void tree(char * const source, int depth) {
+    const int kind = (int)(next_random() % 10);
+
+    if (depth == 0 || kind < 2) {
+        operand(source);
+    } else if (kind == 2) {
+        append(source, "-");
+        tree(source, depth - 1);
+    } else {
+        append(source, "(");
+        tree(source, depth - 1);
+        append(source, random_operator());
+        tree(source, depth - 1);
+        append(source, ")");
+    }
+}
+
+// (x op (x op (x op ...))), which holds one stack slot per level.
+static void nested(char * const source, int depth) {
+    for (int level = 0; level < depth; level++) {
+        append(source, "(");
+        operand(source);
+        append(source, random_operator());
+
+        if (next_random() % 8 == 0) {
+            append(source, "-");
+        }
+    }
+
+    operand(source);
+
+    for (int level = 0; level < depth; level++) {
+        append(source, ")");
+    }
+}
+
+static double from_bits(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static double random_input(void) {
+    switch (next_random() % 10) {
+        case 0: return 0.0;
+        case 1: return -0.0;
+        case 2: return INFINITY;
+        case 3: return -INFINITY;
+        case 4: return from_bits(0x7ff4000000000001u);
+        case 5: return 5e-324;
+        default: return (double)((int64_t)(next_random() % 2001) - 1000) / (double)(1 + next_random() % 7);
+    }
+}
+
+int main(void) {
+    if (!clox_jit_available()) {
+        fprintf(stderr, "This build has no JIT.\n");
+        return 77;
+    }
+
+    CloxVM * const interpreted = clox_vm_new();
+    CloxVM * const compiled = clox_vm_new();
+    clox_vm_set_jit(compiled, 1);
+
+    static char source[SOURCE_SIZE];
+    int mismatches = 0;
+    int spilled = 0;
+
+    // Every program is compiled into the same chunk, as --batch does, so the
+    // native code of one is mapped over that of the one before.
+    CloxChunk chunk;
+    clox_chunk_init(&chunk);
+
+    for (int program = 0; program < PROGRAMS; program++) {
+        source[0] = '\0';
+
+        if (program % 2 == 0) {
+            tree(source, 1 + program % 8);
+        } else {
+            nested(source, 1 + (int)(next_random() % 60));
+        }
+
+        clox_chunk_reset(&chunk);
+
+        if (!clox_compiler_compile_inputs(source, input_names, INPUT_COUNT, &chunk)) {
+            fprintf(stderr, "%s: failed to compile.\n", source);
+            return EXIT_FAILURE;
+        }
+
+        spilled += chunk.max_stack > REGISTER_SLOTS;
+
+        for (int row = 0; row < ROWS; row++) {
+            double inputs[INPUT_COUNT];
+
+            for (int input = 0; input < INPUT_COUNT; input++) {
+                inputs[input] = random_input();
+            }
+
+            CloxValue expected;
+            CloxValue result;
+
+            if (clox_vm_evaluate(compiled, &chunk, inputs, &result) != INTERPRET_OK
+                    || clox_vm_evaluate(interpreted, &chunk, inputs, &expected) != INTERPRET_OK) {
+                fprintf(stderr, "%s: evaluating failed.\n", source);
+                mismatches++;
+            } else if (result != expected) {
+                fprintf(
+                    stderr,
+                    "%s: --jit gives %016llx, the interpreter %016llx.\n",
+                    source,
+                    (unsigned long long)result,
+                    (unsigned long long)expected);
+                mismatches++;
+            }
+        }
+
+        if (chunk.jit == NULL && chunk.count >= CLOX_JIT_MIN_CODE) {
+            fprintf(stderr, "%s: wasn't compiled to native code.\n", source);
+            mismatches++;
+        }
+    }
+
+    clox_chunk_free(&chunk);
+
+    clox_vm_free(interpreted);
+    clox_vm_free(compiled);
+
+    // The nested half should mostly go past the registers.
+    if (spilled < PROGRAMS / 4) {
+        fprintf(stderr, "Only %d programs needed more than %d stack slots.\n", spilled, REGISTER_SLOTS);
+        return EXIT_FAILURE;
+    }
+
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
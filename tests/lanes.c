@@ -0,0 +1,189 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "lane_kernels.h"
+#include "value.h"
+#include "vm.h"
+
+// Runs random expressions through clox_vm_run_lanes() with each set of lane
+// kernels the CPU supports and checks that every result is bit for bit what
+// clox_vm_evaluate() gives for the same row. The inputs mix ordinary values
+// with signed zeros, infinities, subnormals and NaNs with assorted payloads,
+// and the row counts aren't multiples of any vector width.
+
+#define PROGRAMS 300
+#define MAX_ROWS 131
+#define SOURCE_SIZE 4096
+
+static const char * const input_names[] = { "a", "b", "c", "d", "e" };
+
+#define INPUT_COUNT ((int)(sizeof(input_names) / sizeof(input_names[0])))
+
+static const char * const level_names[CLOX_LANE_LEVEL_COUNT] = {
+    [CLOX_LANE_SCALAR] = "scalar",
+    [CLOX_LANE_SSE2] = "sse2",
+    [CLOX_LANE_AVX2] = "avx2"
+};
+
+static uint64_t state = 0x2545f4914f6cdd1du;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void append(char * const source, const char * const text) {
+    if (strlen(source) + strlen(text) < SOURCE_SIZE) {
+        strcat(source, text);
+    }
+}
+
+// An expression of at most `depth` levels of operators over the inputs and
+// small constants.
+static void generate(char * const source, int depth) {
+    const int kind = (int)(next_random() % 10);
+    char text[32];
+
+    if (depth == 0 || kind < 2) {
+        if (kind % 2 == 0) {
+            append(source, input_names[next_random() % INPUT_COUNT]);
+        } else {
+            snprintf(text, sizeof(text), "%d.%d", (int)(next_random() % 1000), (int)(next_random() % 100));
+            append(source, text);
+        }
+
+        return;
+    }
+
+    if (kind == 2) {
+        append(source, "-");
+        generate(source, depth - 1);
+        return;
+    }
+
+    static const char * const operators[] = { " + ", " - ", " * ", " / " };
+
+    append(source, "(");
+    generate(source, depth - 1);
+    append(source, operators[next_random() % 4]);
+    generate(source, depth - 1);
+    append(source, ")");
+}
+
+static double from_bits(uint64_t bits) {
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static double random_input(void) {
+    switch (next_random() % 12) {
+        case 0: return 0.0;
+        case 1: return -0.0;
+        case 2: return INFINITY;
+        case 3: return -INFINITY;
+        case 4: return NAN;
+        case 5: return from_bits(0x7ff4000000000001u);
+        case 6: return from_bits(0xfffc000000000123u);
+        case 7: return from_bits(next_random());
+        case 8: return 5e-324;
+        default: return (double)((int64_t)(next_random() % 2001) - 1000) / (double)(1 + next_random() % 7);
+    }
+}
+
+// Checks one program against every supported set of kernels, returning the
+// number of mismatches.
+static int check_program(CloxVM * const vm, CloxChunk * const chunk, const char * const source) {
+    static double columns[INPUT_COUNT][MAX_ROWS];
+    const double *inputs[INPUT_COUNT];
+    CloxValue expected[MAX_ROWS];
+    double results[MAX_ROWS];
+    const size_t rows = 1 + (size_t)(next_random() % MAX_ROWS);
+
+    for (int input = 0; input < INPUT_COUNT; input++) {
+        for (size_t row = 0; row < rows; row++) {
+            columns[input][row] = random_input();
+        }
+
+        inputs[input] = columns[input];
+    }
+
+    for (size_t row = 0; row < rows; row++) {
+        double values[INPUT_COUNT];
+
+        for (int input = 0; input < INPUT_COUNT; input++) {
+            values[input] = columns[input][row];
+        }
+
+        if (clox_vm_evaluate(vm, chunk, values, &expected[row]) != INTERPRET_OK) {
+            fprintf(stderr, "%s: evaluating row %zu failed.\n", source, row);
+            return 1;
+        }
+    }
+
+    int mismatches = 0;
+
+    for (int level = 0; level < CLOX_LANE_LEVEL_COUNT; level++) {
+        if (!clox_lane_kernels_select((CloxLaneLevel)level)) {
+            continue;
+        }
+
+        if (clox_vm_run_lanes(vm, chunk, inputs, rows, results) != INTERPRET_OK) {
+            fprintf(stderr, "%s: %s lanes failed.\n", source, level_names[level]);
+            mismatches++;
+            continue;
+        }
+
+        for (size_t row = 0; row < rows; row++) {
+            if (memcmp(&results[row], &expected[row], sizeof(double)) != 0) {
+                uint64_t bits;
+                memcpy(&bits, &results[row], sizeof(bits));
+                fprintf(
+                    stderr,
+                    "%s: %s lanes give %016llx for row %zu of %zu, evaluate %016llx.\n",
+                    source,
+                    level_names[level],
+                    (unsigned long long)bits,
+                    row,
+                    rows,
+                    (unsigned long long)expected[row]);
+                mismatches++;
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+int main(void) {
+    CloxVM * const vm = clox_vm_new();
+    static char source[SOURCE_SIZE];
+    int mismatches = 0;
+
+    for (int program = 0; program < PROGRAMS; program++) {
+        source[0] = '\0';
+        generate(source, 1 + program % 9);
+
+        CloxChunk chunk;
+        clox_chunk_init(&chunk);
+
+        if (!clox_compiler_compile_inputs(source, input_names, INPUT_COUNT, &chunk)) {
+            fprintf(stderr, "%s: failed to compile.\n", source);
+            return EXIT_FAILURE;
+        }
+
+        mismatches += check_program(vm, &chunk, source);
+        clox_chunk_free(&chunk);
+    }
+
+    clox_vm_free(vm);
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "value.h"
+#include "vm.h"
+
+// Compiles expressions nested right up to CLOX_COMPILER_MAX_DEPTH, which
+// have to compile and run, and one level past it, which have to fail to
+// compile instead of running out of C stack. So do expressions nested
+// FAR_DEPTH levels deep, which is where the compiler used to crash.
+
+#define FAR_DEPTH 100000
+
+typedef struct CloxNestingShape CloxNestingShape;
+struct CloxNestingShape {
+    const char *name;
+    // What each level adds before and after the innermost operand.
+    const char *open;
+    const char *close;
+    // Levels of recursion in the compiler each of those adds.
+    int depth;
+};
+
+static const CloxNestingShape shapes[] = {
+    { "groupings", "(", ")", 1 },
+    { "negations", "-", "", 1 },
+    { "right operands", "1 - (", ")", 2 }
+};
+
+#define SHAPE_COUNT ((int)(sizeof(shapes) / sizeof(shapes[0])))
+
+static char * nest(const CloxNestingShape * const shape, int levels) {
+    const size_t open = strlen(shape->open);
+    const size_t close = strlen(shape->close);
+    char * const source = malloc((open + close) * (size_t)levels + 2);
+
+    if (source == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *end = source;
+
+    for (int level = 0; level < levels; level++) {
+        memcpy(end, shape->open, open);
+        end += open;
+    }
+
+    *end++ = '1';
+
+    for (int level = 0; level < levels; level++) {
+        memcpy(end, shape->close, close);
+        end += close;
+    }
+
+    *end = '\0';
+    return source;
+}
+
+// Whether `levels` levels of `shape` compile and, if they do, run.
+static bool compiles(CloxVM * const vm, const CloxNestingShape * const shape, int levels) {
+    char * const source = nest(shape, levels);
+    CloxChunk chunk;
+    clox_chunk_init(&chunk);
+
+    bool ok = clox_compiler_compile(source, &chunk);
+
+    if (ok) {
+        CloxValue result;
+
+        if (clox_vm_evaluate(vm, &chunk, NULL, &result) != INTERPRET_OK || !CLOX_IS_NUMBER(result)) {
+            fprintf(stderr, "%d levels of %s compile but don't run.\n", levels, shape->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    clox_chunk_free(&chunk);
+    free(source);
+    return ok;
+}
+
+int main(void) {
+    CloxVM * const vm = clox_vm_new();
+    int failures = 0;
+
+    for (int i = 0; i < SHAPE_COUNT; i++) {
+        const CloxNestingShape * const shape = &shapes[i];
+
+        // The outermost operand is one level of its own.
+        const int deepest = (CLOX_COMPILER_MAX_DEPTH - 1) / shape->depth;
+
+        if (!compiles(vm, shape, deepest)) {
+            fprintf(stderr, "%d levels of %s don't compile.\n", deepest, shape->name);
+            failures++;
+        }
+
+        if (compiles(vm, shape, deepest + 1)) {
+            fprintf(stderr, "%d levels of %s compile.\n", deepest + 1, shape->name);
+            failures++;
+        }
+
+        if (compiles(vm, shape, FAR_DEPTH)) {
+            fprintf(stderr, "%d levels of %s compile.\n", FAR_DEPTH, shape->name);
+            failures++;
+        }
+    }
+
+    clox_vm_free(vm);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
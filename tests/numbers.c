@@ -0,0 +1,246 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+
+// Checks clox_number_parse() against strtod() on random literals of every
+// shape the slow path has to deal with, and clox_number_format() on random
+// doubles: its text must read back as the same double and have no more
+// significant digits than the shortest %.*e that does.
+
+#define LITERALS 200000
+#define DOUBLES 100000
+#define LITERAL_SIZE 800
+
+static uint64_t state = 0x9e3779b97f4a7c15u;
+
+static uint64_t next_random(void) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static char random_digit(void) {
+    return (char)('0' + next_random() % 10);
+}
+
+static int append_digits(char * const literal, int length, int count) {
+    for (int i = 0; i < count; i++) {
+        literal[length++] = random_digit();
+    }
+
+    return length;
+}
+
+static int append_run(char * const literal, int length, char digit, int count) {
+    memset(literal + length, digit, (size_t)count);
+    return length + count;
+}
+
+// A literal as the scanner accepts it: digits, optionally '.' and more digits.
+// Returns its length; it isn't terminated.
+static int generate_literal(char * const literal) {
+    int length = 0;
+
+    switch (next_random() % 7) {
+        case 0:
+            // Short literals, nearly all on the fast path.
+            length = append_digits(literal, length, 1 + (int)(next_random() % 8));
+
+            if (next_random() % 2 == 0) {
+                literal[length++] = '.';
+                length = append_digits(literal, length, 1 + (int)(next_random() % 8));
+            }
+
+            break;
+
+        case 1:
+            // Around the 19 digits the accumulator holds and 2^53.
+            length = append_digits(literal, length, 15 + (int)(next_random() % 8));
+
+            if (next_random() % 2 == 0) {
+                literal[length++] = '.';
+                length = append_digits(literal, length, 1 + (int)(next_random() % 6));
+            }
+
+            break;
+
+        case 2:
+            // Large integers, up to past the point they overflow to inf.
+            literal[length++] = (char)('1' + next_random() % 9);
+            length = append_digits(literal, length, (int)(next_random() % 330));
+            break;
+
+        case 3:
+            // Tiny fractions, down into the subnormals and past them.
+            literal[length++] = '0';
+            literal[length++] = '.';
+            length = append_run(literal, length, '0', (int)(next_random() % 350));
+            length = append_digits(literal, length, 1 + (int)(next_random() % 20));
+            break;
+
+        case 4:
+            // Halfway cases: a double's worth of digits, then a 5 and zeros.
+            length = append_digits(literal, length, 16 + (int)(next_random() % 3));
+            literal[length++] = '5';
+            length = append_run(literal, length, '0', (int)(next_random() % 40));
+
+            if (next_random() % 2 == 0) {
+                literal[length++] = '1';
+            }
+
+            break;
+
+        case 5:
+            // Long runs of 9s and 0s on either side of the point.
+            length = append_run(literal, length, next_random() % 2 == 0 ? '9' : '1', 1 + (int)(next_random() % 30));
+            literal[length++] = '.';
+            length = append_run(literal, length, next_random() % 2 == 0 ? '9' : '0', (int)(next_random() % 60));
+            length = append_digits(literal, length, (int)(next_random() % 3));
+            break;
+
+        default:
+            // Leading zeros, which don't count towards the 19 digits.
+            length = append_run(literal, length, '0', 1 + (int)(next_random() % 30));
+            length = append_digits(literal, length, 1 + (int)(next_random() % 25));
+            literal[length++] = '.';
+            length = append_digits(literal, length, 1 + (int)(next_random() % 25));
+            break;
+    }
+
+    return length;
+}
+
+static bool same_bits(double a, double b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static int check_literals(void) {
+    static char literal[LITERAL_SIZE];
+    static char terminated[LITERAL_SIZE];
+    int mismatches = 0;
+
+    for (int i = 0; i < LITERALS; i++) {
+        const int length = generate_literal(literal);
+
+        // Digits after the literal, which the parser mustn't read.
+        literal[length] = random_digit();
+        literal[length + 1] = '\0';
+
+        memcpy(terminated, literal, (size_t)length);
+        terminated[length] = '\0';
+
+        const double parsed = clox_number_parse(literal, length);
+        const double expected = strtod(terminated, NULL);
+
+        if (!same_bits(parsed, expected)) {
+            fprintf(stderr, "Parsing %s gives %.17g, strtod %.17g.\n", terminated, parsed, expected);
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+// Significant digits in formatted text, leaving out the sign, the point,
+// the exponent and zeros at either end.
+static int significant_digits(const char * const text) {
+    char digits[CLOX_NUMBER_FORMAT_MAX];
+    int count = 0;
+
+    for (const char *c = text; *c != '\0' && *c != 'e'; c++) {
+        if (*c >= '0' && *c <= '9' && (count > 0 || *c != '0')) {
+            digits[count++] = *c;
+        }
+    }
+
+    while (count > 0 && digits[count - 1] == '0') {
+        count--;
+    }
+
+    return count;
+}
+
+static int shortest_digits(double value) {
+    char text[64];
+
+    for (int precision = 1; precision < 17; precision++) {
+        snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+
+        if (same_bits(strtod(text, NULL), value)) {
+            return precision;
+        }
+    }
+
+    return 17;
+}
+
+static double random_double(void) {
+    uint64_t bits = next_random();
+
+    // Half of them in the range that's written out in full.
+    if (next_random() % 2 == 0) {
+        const uint64_t exponent = 1003 + next_random() % 80;
+        bits = (bits & 0x800fffffffffffffu) | (exponent << 52);
+    }
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static int check_formatting(void) {
+    char text[CLOX_NUMBER_FORMAT_MAX];
+    int mismatches = 0;
+
+    for (int i = 0; i < DOUBLES; i++) {
+        const double value = random_double();
+
+        if (!isfinite(value)) {
+            continue;
+        }
+
+        const int length = clox_number_format(value, text);
+
+        if (length <= 0 || length >= CLOX_NUMBER_FORMAT_MAX || (int)strlen(text) != length) {
+            fprintf(stderr, "Formatting %.17g gives a length of %d.\n", value, length);
+            mismatches++;
+            continue;
+        }
+
+        if (!same_bits(strtod(text, NULL), value)) {
+            fprintf(stderr, "Formatting %.17g gives %s, which doesn't read back.\n", value, text);
+            mismatches++;
+            continue;
+        }
+
+        // Text written out in full is also a literal clox_number_parse() takes.
+        if (strchr(text, 'e') == NULL) {
+            const bool negative = text[0] == '-';
+            const double parsed = clox_number_parse(text + negative, length - negative);
+
+            if (!same_bits(negative ? -parsed : parsed, value)) {
+                fprintf(stderr, "Formatting %.17g gives %s, which parses back differently.\n", value, text);
+                mismatches++;
+                continue;
+            }
+        }
+
+        if (significant_digits(text) > shortest_digits(value)) {
+            fprintf(stderr, "Formatting %.17g gives %s, which isn't the shortest.\n", value, text);
+            mismatches++;
+        }
+    }
+
+    return mismatches;
+}
+
+int main(void) {
+    const int mismatches = check_literals() + check_formatting();
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk.h"
+#include "compiler.h"
+#include "errors.h"
+#include "value.h"
+#include "vm.h"
+
+// Runs many VMs at once, one per thread, through everything a VM does:
+// scanning and compiling source, running chunks with and without --jit,
+// clox_vm_evaluate() and clox_vm_run_lanes(). Nothing runs before the threads
+// start, so they also race to set up whatever is set up on first use. Each
+// thread checks clox_vm_run_lanes() against clox_vm_evaluate(), and the main
+// thread checks that they all got the same. Configure with -Db_sanitize=thread
+// to have ThreadSanitizer check that nothing is shared.
+
+#define THREADS 8
+#define ROUNDS 200
+#define ROWS 37
+
+static const char * const scripts[] = {
+    "-(1 + 2) * 3 / 4",
+    "1.5 * (2 - 0.25) + 1.0",
+    "(((((((((((((((((1 + 2) * 3) - 4) / 5) + 6) * 7) - 8) / 9) + 10) * 11) - 12) / 13) + 14) * 15) - 16) / 17) + 18)",
+    "nil",
+    "true",
+    "// comment\n   123456789.125   \n",
+    // Too many digits for clox_number_parse() to work out on its own, so these
+    // go through strtod(), the last one with a copy on the heap.
+    "123456789012345678901234567890 / 7",
+    "0.1000000000000000055511151231257827021181583404541015625 * 3",
+    "3.14159265358979323846264338327950288419716939937510582097494459230781640628620899862803482534211706798 - 1"
+};
+
+#define SCRIPT_COUNT ((int)(sizeof(scripts) / sizeof(scripts[0])))
+
+static const char * const input_names[] = { "a", "b", "c" };
+
+#define INPUT_COUNT ((int)(sizeof(input_names) / sizeof(input_names[0])))
+
+static const char * const formula = "(a * b - c) / (a + 0.5) + -(b - c * 2) * (a * (b * (c + a)))";
+
+static double columns[INPUT_COUNT][ROWS];
+
+// Holds the threads back until they can all start at once.
+static pthread_barrier_t start;
+
+typedef struct CloxTestWorker CloxTestWorker;
+struct CloxTestWorker {
+    pthread_t thread;
+    int index;
+    int failures;
+    CloxValue results[ROWS];
+};
+
+static void fill_columns(void) {
+    for (int input = 0; input < INPUT_COUNT; input++) {
+        for (int row = 0; row < ROWS; row++) {
+            columns[input][row] = (double)((row * 7 + input * 13) % 29 - 14) / (double)(input + 2);
+        }
+    }
+}
+
+static bool compile_formula(CloxChunk * const chunk) {
+    clox_chunk_init(chunk);
+    return clox_compiler_compile_inputs(formula, input_names, INPUT_COUNT, chunk);
+}
+
+static bool evaluate_row(CloxVM * const vm, CloxChunk * const chunk, int row, CloxValue * const result) {
+    double inputs[INPUT_COUNT];
+
+    for (int input = 0; input < INPUT_COUNT; input++) {
+        inputs[input] = columns[input][row];
+    }
+
+    return clox_vm_evaluate(vm, chunk, inputs, result) == INTERPRET_OK;
+}
+
+static void *work(void *argument) {
+    CloxTestWorker * const worker = (CloxTestWorker *)argument;
+    pthread_barrier_wait(&start);
+
+    CloxVM * const vm = clox_vm_new();
+    clox_vm_set_output_batching(vm, true);
+
+    // Every other thread runs numeric chunks as native code.
+    if (worker->index % 2 == 1) {
+        clox_vm_set_jit(vm, 1);
+    }
+
+    CloxChunk chunk;
+
+    if (!compile_formula(&chunk)) {
+        worker->failures++;
+        clox_vm_free(vm);
+        return NULL;
+    }
+
+    const double *inputs[INPUT_COUNT];
+
+    for (int input = 0; input < INPUT_COUNT; input++) {
+        inputs[input] = columns[input];
+    }
+
+    double lanes[ROWS];
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int script = 0; script < SCRIPT_COUNT; script++) {
+            worker->failures += clox_vm_interpret(vm, scripts[script]) != INTERPRET_OK;
+        }
+
+        for (int row = 0; row < ROWS; row++) {
+            CloxValue result;
+            worker->failures += !evaluate_row(vm, &chunk, row, &result);
+
+            if (round == 0) {
+                worker->results[row] = result;
+            } else {
+                worker->failures += result != worker->results[row];
+            }
+        }
+
+        // A different row count each round, to cover every remainder.
+        const size_t count = (size_t)(ROWS - round % 8);
+
+        if (clox_vm_run_lanes(vm, &chunk, inputs, count, lanes) != INTERPRET_OK) {
+            worker->failures++;
+            continue;
+        }
+
+        for (size_t row = 0; row < count; row++) {
+            worker->failures += memcmp(&lanes[row], &worker->results[row], sizeof(double)) != 0;
+        }
+    }
+
+    clox_chunk_free(&chunk);
+    clox_vm_free(vm);
+    return NULL;
+}
+
+int main(void) {
+    // The scripts print their results, which only get in the way here.
+    if (freopen("/dev/null", "w", stdout) == NULL) {
+        fprintf(stderr, "Failed to redirect standard output.\n");
+        return CLOX_EXIT_FILE_ERROR;
+    }
+
+    fill_columns();
+    pthread_barrier_init(&start, NULL, THREADS);
+
+    CloxTestWorker workers[THREADS];
+
+    for (int i = 0; i < THREADS; i++) {
+        workers[i].index = i;
+        workers[i].failures = 0;
+
+        if (pthread_create(&workers[i].thread, NULL, work, &workers[i]) != 0) {
+            fprintf(stderr, "Failed to start thread %d.\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int failures = 0;
+
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(workers[i].thread, NULL);
+
+        if (memcmp(workers[i].results, workers[0].results, sizeof(workers[0].results)) != 0) {
+            workers[i].failures++;
+        }
+
+        if (workers[i].failures > 0) {
+            fprintf(stderr, "Thread %d: %d failures.\n", i, workers[i].failures);
+        }
+
+        failures += workers[i].failures;
+    }
+
+    pthread_barrier_destroy(&start);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}